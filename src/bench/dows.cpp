@@ -0,0 +1,307 @@
+// Copyright (c) 2018 The Sthcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <chainparamsbase.h>
+#include <hash.h>
+#include <random.h>
+#include <uint256.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+// Each stage of DowsHash() is measured on its own, then the whole hash cold
+// (test = true, bypassing the cache) and as a cache hit. The _4Threads variants
+// run three more threads doing the same work in the background, which shows
+// how the stage scales under memory bandwidth or lock contention.
+
+/** Number of distinct inputs cycled through, so no stage runs on one hot input */
+static const size_t DOWS_BENCH_INPUTS = 64;
+
+static std::vector<uint256> DowsBenchInputs()
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> inputs;
+    for (size_t i = 0; i < DOWS_BENCH_INPUTS; ++i) {
+        inputs.push_back(rng.rand256());
+    }
+    return inputs;
+}
+
+static void DowsBenchSeed(const uint256& input, uint64_t& seed, uint64_t& incr)
+{
+    seed = 0;
+    incr = 0;
+    DowsMixSeed(input.begin(), seed, incr);
+}
+
+/** Run work on three background threads until the returned guard goes out of scope */
+class DowsBenchBackground
+{
+public:
+    template <typename Work>
+    explicit DowsBenchBackground(Work work)
+    {
+        for (int i = 0; i < 3; ++i) {
+            threads.emplace_back([this, work, i] {
+                for (size_t n = i; !stop; ++n) {
+                    work(n);
+                }
+            });
+        }
+    }
+
+    ~DowsBenchBackground()
+    {
+        stop = true;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+};
+
+static void DowsMakeHashCode(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    std::vector<char> code(100000);
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[n++ % inputs.size()], seed, incr);
+        MakeHashCode(seed, incr, code.data());
+    }
+}
+
+static void DowsMakeHashProgram(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    DowsProgram program;
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[n++ % inputs.size()], seed, incr);
+        MakeHashProgram(seed, incr, program);
+    }
+}
+
+static void DowsLuaState(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        lua_close(NewDowsLuaState());
+    }
+}
+
+// The cost of a shuffle depends a lot on the program, so each input runs its own
+static void DowsShuffleLua(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    std::vector<lua_State*> programs;
+    std::vector<char> code(100000);
+    for (const uint256& input : inputs) {
+        uint64_t seed, incr;
+        DowsBenchSeed(input, seed, incr);
+        MakeHashCode(seed, incr, code.data());
+        programs.push_back(NewDowsLuaState());
+        luaL_loadstring(programs.back(), code.data());
+        lua_pcall(programs.back(), 0, 0, 0);
+    }
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ % inputs.size();
+        uint256 h = inputs[i];
+        ShuffleHash256(programs[i], h.begin());
+    }
+    for (lua_State* L : programs) {
+        lua_close(L);
+    }
+}
+
+static void DowsShuffleNative(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    std::vector<DowsProgram> programs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[i], seed, incr);
+        MakeHashProgram(seed, incr, programs[i]);
+    }
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ % inputs.size();
+        uint256 h = inputs[i];
+        ShuffleHash256(programs[i], h.begin());
+    }
+}
+
+// DOWS_BATCH_SIZE shuffles per iteration, interleaved on DOWS_BATCH_LANES lanes
+static void DowsShuffleNativeLanes(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    std::vector<DowsProgram> programs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[i], seed, incr);
+        MakeHashProgram(seed, incr, programs[i]);
+    }
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ * DOWS_BATCH_SIZE % inputs.size();
+        uint256 h[DOWS_BATCH_SIZE];
+        uint8_t* hashes[DOWS_BATCH_SIZE];
+        for (size_t l = 0; l < DOWS_BATCH_SIZE; ++l) {
+            h[l] = inputs[i + l];
+            hashes[l] = h[l].begin();
+        }
+        ShuffleHash256Lanes(&programs[i], hashes, DOWS_BATCH_SIZE);
+    }
+}
+
+static void DowsHashBaseReads(benchmark::State& state)
+{
+    assert(InitHashBase());
+    std::vector<uint256> inputs = DowsBenchInputs();
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[n++ % inputs.size()], seed, incr);
+        CHash256 hasher;
+        DowsSampleHashBase(seed, incr, hasher);
+    }
+}
+
+static void DowsHashBaseReads_4Threads(benchmark::State& state)
+{
+    assert(InitHashBase());
+    std::vector<uint256> inputs = DowsBenchInputs();
+    DowsBenchBackground background([&inputs](size_t n) {
+        uint64_t seed, incr;
+        DowsBenchSeed(inputs[n % inputs.size()], seed, incr);
+        CHash256 hasher;
+        DowsSampleHashBase(seed, incr, hasher);
+    });
+    DowsHashBaseReads(state);
+}
+
+static void DowsHashCold(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        DowsHash(inputs[n++ % inputs.size()], false, true);
+    }
+}
+
+static void DowsHashCold_4Threads(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchInputs();
+    DowsBenchBackground background([&inputs](size_t n) {
+        DowsHash(inputs[n % inputs.size()], false, true);
+    });
+    DowsHashCold(state);
+}
+
+// The reference engine reuses its thread's Lua state from one hash to the next
+static void DowsHashColdLua(benchmark::State& state)
+{
+    const DowsEngine engine = g_dows_engine;
+    g_dows_engine = DowsEngine::LUA;
+    DowsHashCold(state);
+    g_dows_engine = engine;
+}
+
+// DOWS_BATCH_SIZE nonces of a header per iteration, none of them solving
+static void DowsHashBatchLanes(benchmark::State& state)
+{
+    std::vector<unsigned char> header(DOWS_HEADER_SIZE, 0x5a);
+    uint32_t nonce = 0;
+    while (state.KeepRunning()) {
+        uint32_t solution, hashes;
+        uint256 hash;
+        DowsHashBatch(header.data(), nonce, DOWS_BATCH_SIZE, uint256(), solution, hash, hashes);
+        nonce += hashes;
+    }
+}
+
+// Fill the DOWS hash cache with made-up hashes for the inputs, so lookups hit
+static std::vector<uint256> DowsBenchCachedInputs()
+{
+    static std::once_flag init;
+    std::call_once(init, [] { InitDowsHashCache(); });
+    std::vector<uint256> inputs = DowsBenchInputs();
+    for (uint256 raw : inputs) {
+        uint256 dows = raw;
+        AddToDowsHashCache(raw, dows);
+    }
+    return inputs;
+}
+
+static void DowsHashCacheHit(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchCachedInputs();
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        DowsHash(inputs[n++ % inputs.size()], false);
+    }
+}
+
+static void DowsHashCacheHit_4Threads(benchmark::State& state)
+{
+    std::vector<uint256> inputs = DowsBenchCachedInputs();
+    DowsBenchBackground background([&inputs](size_t n) {
+        DowsHash(inputs[n % inputs.size()], false);
+    });
+    DowsHashCacheHit(state);
+}
+
+// Real headers with known hashes: a change in the output fails the run, not
+// just the timing
+static void DowsGenesisCorpus(benchmark::State& state)
+{
+    std::vector<CBlock> blocks;
+    std::vector<uint256> expected;
+    for (const std::string& chain : {CBaseChainParams::MAIN, CBaseChainParams::TESTNET, CBaseChainParams::REGTEST}) {
+        std::unique_ptr<const CChainParams> params = CreateChainParams(chain);
+        blocks.push_back(params->GenesisBlock());
+        expected.push_back(params->GetConsensus().hashGenesisBlock);
+    }
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ % blocks.size();
+        assert(blocks[i].GetTestHash() == expected[i]);
+    }
+}
+
+BENCHMARK(DowsMakeHashCode, 15 * 1000);
+BENCHMARK(DowsMakeHashProgram, 1700 * 1000);
+BENCHMARK(DowsLuaState, 17 * 1000);
+BENCHMARK(DowsShuffleLua, 100);
+BENCHMARK(DowsShuffleNative, 200);
+BENCHMARK(DowsShuffleNativeLanes, 20);
+BENCHMARK(DowsHashBaseReads, 3300);
+BENCHMARK(DowsHashBaseReads_4Threads, 3300);
+BENCHMARK(DowsHashCold, 200);
+BENCHMARK(DowsHashCold_4Threads, 200);
+BENCHMARK(DowsHashColdLua, 100);
+BENCHMARK(DowsHashBatchLanes, 12);
+BENCHMARK(DowsHashCacheHit, 30 * 1000 * 1000);
+BENCHMARK(DowsHashCacheHit_4Threads, 30 * 1000 * 1000);
+BENCHMARK(DowsGenesisCorpus, 200);
@@ -5,6 +5,8 @@
 
 #include <chain.h>
 
+#include <mutex> // + 
+
 /**
  * CChain implementation
  */
@@ -113,20 +115,31 @@ CBlockIndex* CBlockIndex::GetAncestor(int height)
 }
 
 
-// + 
-// In order for this to work, the difficulty can't be too easy, otherwise there will be overflow when summing for average
-// Approximiately, it should be tuned so that difficulty * (number of blocks in one adjustment span) <= 0xFF...FF (32 bytes))
-const CBlockIndex* CBlockIndex::GetAncestorAndAverageDifficulty (int height, arith_uint256 & diffBits) const
+// { + 
+namespace {
+
+/** One remembered GetAncestorAndAverageDifficulty() result */
+struct AverageDifficultyEntry
 {
-    diffBits.SetCompact(nBits);
+    uint256 hash;
+    int height = -1;
+    const CBlockIndex* ancestor = nullptr;
+    arith_uint256 diffBits;
+};
 
-    if (height > nHeight || height < 0) {
-        return nullptr;
-    }
+/** Number of remembered results; a tip is asked for at most two heights */
+static const size_t AVERAGE_DIFFICULTY_MEMO_SIZE = 64;
 
+std::mutex g_average_difficulty_mutex;
+AverageDifficultyEntry g_average_difficulty_memo[AVERAGE_DIFFICULTY_MEMO_SIZE];
+
+// In order for this to work, the difficulty can't be too easy, otherwise there will be overflow when summing for average
+// Approximiately, it should be tuned so that difficulty * (number of blocks in one adjustment span) <= 0xFF...FF (32 bytes))
+// The sum runs over the blocks the skip list walk visits, so it is only known by doing the walk
+const CBlockIndex* WalkAncestorAndAverageDifficulty(const CBlockIndex* pindexWalk, int height, arith_uint256 & diffBits)
+{
     arith_uint256 bits = arith_uint256 (0);
-    const CBlockIndex* pindexWalk = static_cast<const CBlockIndex*> (this);
-    int heightWalk = nHeight;
+    int heightWalk = pindexWalk->nHeight;
     int n = 0;
     while (heightWalk > height) {
         int heightSkip = GetSkipHeight(heightWalk);
@@ -154,6 +167,49 @@ const CBlockIndex* CBlockIndex::GetAncestorAndAverageDifficulty (int height, ari
     return pindexWalk;
 }
 
+} // namespace
+
+// GetNextWorkRequired() asks the same question for every template built and
+// every header and block checked on top of a tip, so the answers are remembered
+// by block hash, which fixes the whole chain below it.
+const CBlockIndex* CBlockIndex::GetAncestorAndAverageDifficulty (int height, arith_uint256 & diffBits) const
+{
+    diffBits.SetCompact(nBits);
+
+    if (height > nHeight || height < 0) {
+        return nullptr;
+    }
+    if (phashBlock == nullptr) {
+        return WalkAncestorAndAverageDifficulty(this, height, diffBits);
+    }
+
+    AverageDifficultyEntry& entry = g_average_difficulty_memo[(GetBlockHash().GetCheapHash() + height) % AVERAGE_DIFFICULTY_MEMO_SIZE];
+    {
+        std::lock_guard<std::mutex> lock(g_average_difficulty_mutex);
+        if (entry.height == height && entry.hash == *phashBlock) {
+            diffBits = entry.diffBits;
+            return entry.ancestor;
+        }
+    }
+
+    const CBlockIndex* ancestor = WalkAncestorAndAverageDifficulty(this, height, diffBits);
+    std::lock_guard<std::mutex> lock(g_average_difficulty_mutex);
+    entry.hash = *phashBlock;
+    entry.height = height;
+    entry.ancestor = ancestor;
+    entry.diffBits = diffBits;
+    return ancestor;
+}
+
+void ClearAverageDifficultyMemo()
+{
+    std::lock_guard<std::mutex> lock(g_average_difficulty_mutex);
+    for (AverageDifficultyEntry& entry : g_average_difficulty_memo) {
+        entry = AverageDifficultyEntry();
+    }
+}
+// } + 
+
 void CBlockIndex::BuildSkip()
 {
     if (pprev)
@@ -154,6 +154,13 @@ public:
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
+    // { + 
+    //! Retrieve the Coins for several outpoints at once, leaving coins[i] spent where
+    //! outpoints[i] is not found. Returns how many of the lookups missed every cache
+    //! on the way down and had to be read from storage.
+    virtual size_t GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const;
+    // } + 
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -164,8 +171,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. Unless erase is true, its entries
+    //! are left in place and keep their coins.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true); // & 
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -191,7 +199,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override; // & 
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -222,9 +230,10 @@ public:
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
+    size_t GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override; // + 
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override; // & 
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -236,6 +245,15 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    // { + 
+    /**
+     * Load the coins of the given outpoints that are not in this cache yet,
+     * with a single GetCoins() call to the backing view. Returns how many of
+     * them had to be read from storage.
+     */
+    size_t Prefetch(const std::vector<COutPoint>& outpoints) const;
+    // } + 
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -268,6 +286,16 @@ public:
      */
     bool Flush();
 
+    // { + 
+    /**
+     * Push the modifications applied to this cache to its base like Flush(),
+     * but keep the unspent entries cached, marked as unmodified. Spent
+     * entries are dropped as the base no longer has them either.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+    // } + 
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
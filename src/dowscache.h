@@ -0,0 +1,364 @@
+// Copyright (c) 2018 The Sthcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STHCOIN_DOWSCACHE_H
+#define STHCOIN_DOWSCACHE_H
+
+#include <memusage.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/** CDowsHashCache maps the plain SHA256d header hash to its DOWS hash.
+ *
+ * The table is split into shards, each a fixed-size open-addressing array with
+ * its own writer mutex. Lookups take no lock: every slot carries a sequence
+ * counter that writers make odd while they update the slot, and readers retry
+ * the slot when the counter moved under them (a seqlock).
+ *
+ * Keys are SHA256d outputs, so their words are used directly to pick the shard
+ * and the slot. A key probes PROBE_WINDOW consecutive slots of its shard. When
+ * they are all taken, an entry is evicted: the lowest Level first, and the one
+ * written longest ago among equals. ACTIVE entries are pinned and never evicted;
+ * an insert into a window of pinned entries is dropped.
+ *
+ * setup() is not thread safe and must run before the cache is shared. Before
+ * setup() every lookup misses and inserts are dropped.
+ */
+class CDowsHashCache
+{
+public:
+    static const int SHARD_BITS = 6;
+    static const size_t SHARDS = (size_t) 1 << SHARD_BITS;
+    static const size_t PROBE_WINDOW = 8;
+
+    /** How much an entry is worth keeping */
+    enum Level : uint8_t {
+        TRANSIENT = 0, //!< not known to the block index: junk headers, mined nonces
+        INDEXED = 1,   //!< header in the block index but not in the active chain
+        ACTIVE = 2,    //!< header in the active chain; pinned
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t inserts = 0;
+        uint64_t evictions = 0;
+        uint64_t dropped = 0;    //!< inserts that found only pinned entries
+        uint64_t contention = 0; //!< writes that found the shard mutex taken
+        uint64_t entries = 0;
+        uint64_t pinned = 0;
+        uint64_t capacity = 0;
+        size_t usage = 0;        //!< bytes, as DynamicMemoryUsage()
+    };
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;  //!< even when stable, 0 when empty
+        uint32_t tick;              //!< shard insert count when written; writers only
+        uint8_t level;              //!< Level; writers only
+        std::atomic<uint64_t> key[4];
+        std::atomic<uint64_t> value[4];
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        uint32_t tick = 0;
+        uint64_t entries = 0;
+        uint64_t pinned = 0;
+        uint64_t evictions = 0;
+        uint64_t dropped = 0;
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> inserts{0};
+        std::atomic<uint64_t> contention{0};
+        char padding[64]; //!< keeps the counters of neighbouring shards off each other's cache line
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<Shard[]> shards;
+    size_t per_shard = 0;
+
+    static uint64_t Word(const uint256& h, int i)
+    {
+        uint64_t w;
+        memcpy(&w, h.begin() + 8 * i, 8);
+        return w;
+    }
+
+    Slot& SlotAt(size_t shard, uint64_t index, size_t probe) const
+    {
+        // Map the top 32 bits of index onto [0, per_shard) without a division
+        size_t i = (size_t) (((index >> 32) * per_shard) >> 32) + probe;
+        return slots[shard * per_shard + (i < per_shard ? i : i - per_shard)];
+    }
+
+    static bool Read(const Slot& slot, const uint64_t key[4], uint256& value)
+    {
+        for (;;) {
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == 0) {
+                return false;
+            }
+            if (seq & 1) {
+                continue;
+            }
+            bool match = true;
+            uint64_t v[4];
+            for (int i = 0; i < 4; ++i) {
+                match &= slot.key[i].load(std::memory_order_relaxed) == key[i];
+                v[i] = slot.value[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                continue;
+            }
+            if (match) {
+                memcpy(value.begin(), v, 32);
+            }
+            return match;
+        }
+    }
+
+    static void Write(Slot& slot, const uint64_t key[4], const uint256& value)
+    {
+        uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+        slot.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < 4; ++i) {
+            slot.key[i].store(key[i], std::memory_order_relaxed);
+            slot.value[i].store(Word(value, i), std::memory_order_relaxed);
+        }
+        slot.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    static bool Matches(const Slot& slot, const uint64_t key[4])
+    {
+        return slot.seq.load(std::memory_order_relaxed) != 0 &&
+               slot.key[0].load(std::memory_order_relaxed) == key[0] && slot.key[1].load(std::memory_order_relaxed) == key[1] &&
+               slot.key[2].load(std::memory_order_relaxed) == key[2] && slot.key[3].load(std::memory_order_relaxed) == key[3];
+    }
+
+    std::unique_lock<std::mutex> LockShard(Shard& s) const
+    {
+        std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            s.contention.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+        return lock;
+    }
+
+    /** Insert under the shard mutex */
+    void Insert(Shard& s, size_t shard, const uint64_t key[4], const uint256& dows)
+    {
+        Slot* victim = nullptr;
+        bool victim_empty = false;
+        for (size_t probe = 0; probe < PROBE_WINDOW; ++probe) {
+            Slot& slot = SlotAt(shard, key[1], probe);
+            if (slot.seq.load(std::memory_order_relaxed) == 0) {
+                if (!victim_empty) {
+                    victim = &slot;
+                    victim_empty = true;
+                }
+                continue;
+            }
+            if (Matches(slot, key)) {
+                return;
+            }
+            if (victim_empty || slot.level == ACTIVE) {
+                continue;
+            }
+            if (!victim || slot.level < victim->level ||
+                (slot.level == victim->level && (uint32_t) (s.tick - slot.tick) > (uint32_t) (s.tick - victim->tick))) {
+                victim = &slot;
+            }
+        }
+        if (!victim) {
+            ++s.dropped;
+            return;
+        }
+        if (victim_empty) {
+            ++s.entries;
+        } else {
+            ++s.evictions;
+        }
+        victim->tick = ++s.tick;
+        victim->level = TRANSIENT;
+        Write(*victim, key, dows);
+        s.inserts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    /** Allocate room for at least the given number of entries, rounded up to a
+     *  multiple of the shard count. Returns the number of entries the cache can hold. */
+    size_t setup(size_t entries)
+    {
+        per_shard = std::max((size_t) PROBE_WINDOW, (entries + SHARDS - 1) / SHARDS);
+        slots.reset(new Slot[per_shard * SHARDS]);
+        for (size_t i = 0; i < per_shard * SHARDS; ++i) {
+            slots[i].seq.store(0, std::memory_order_relaxed);
+            slots[i].tick = 0;
+            slots[i].level = TRANSIENT;
+        }
+        shards.reset(new Shard[SHARDS]);
+        return per_shard * SHARDS;
+    }
+
+    /** Allocate as many entries as fit in bytes, but at least one probe window
+     *  per shard. Returns the number of entries the cache can hold. */
+    size_t setup_bytes(size_t bytes)
+    {
+        size_t entries = std::max((size_t) PROBE_WINDOW, bytes / sizeof(Slot) / SHARDS) * SHARDS;
+        while (entries > PROBE_WINDOW * SHARDS && Usage(entries) > bytes) {
+            entries -= SHARDS;
+        }
+        return setup(entries);
+    }
+
+    static size_t Usage(size_t entries)
+    {
+        return memusage::MallocUsage(sizeof(Slot) * entries) + memusage::MallocUsage(sizeof(Shard) * SHARDS);
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        if (!slots) {
+            return 0;
+        }
+        return Usage(per_shard * SHARDS);
+    }
+
+    bool Get(const uint256& raw, uint256& dows) const
+    {
+        if (!slots) {
+            return false;
+        }
+        const uint64_t key[4] = {Word(raw, 0), Word(raw, 1), Word(raw, 2), Word(raw, 3)};
+        size_t shard = key[0] & (SHARDS - 1);
+        for (size_t probe = 0; probe < PROBE_WINDOW; ++probe) {
+            if (Read(SlotAt(shard, key[1], probe), key, dows)) {
+                shards[shard].hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        shards[shard].misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void Put(const uint256& raw, const uint256& dows)
+    {
+        if (!slots) {
+            return;
+        }
+        const uint64_t key[4] = {Word(raw, 0), Word(raw, 1), Word(raw, 2), Word(raw, 3)};
+        size_t shard = key[0] & (SHARDS - 1);
+        Shard& s = shards[shard];
+        std::unique_lock<std::mutex> lock = LockShard(s);
+        Insert(s, shard, key, dows);
+    }
+
+    /** Insert many entries, taking each shard mutex once. */
+    void PutBatch(const std::vector<std::pair<uint256, uint256>>& entries)
+    {
+        if (!slots) {
+            return;
+        }
+        std::vector<std::vector<size_t>> by_shard(SHARDS);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            by_shard[Word(entries[i].first, 0) & (SHARDS - 1)].push_back(i);
+        }
+        for (size_t shard = 0; shard < SHARDS; ++shard) {
+            if (by_shard[shard].empty()) {
+                continue;
+            }
+            Shard& s = shards[shard];
+            std::unique_lock<std::mutex> lock = LockShard(s);
+            for (size_t i : by_shard[shard]) {
+                const uint256& raw = entries[i].first;
+                const uint64_t key[4] = {Word(raw, 0), Word(raw, 1), Word(raw, 2), Word(raw, 3)};
+                Insert(s, shard, key, entries[i].second);
+            }
+        }
+    }
+
+    /** Change the Level of an entry. Returns false if it is not cached. */
+    bool SetLevel(const uint256& raw, Level level)
+    {
+        if (!slots) {
+            return false;
+        }
+        const uint64_t key[4] = {Word(raw, 0), Word(raw, 1), Word(raw, 2), Word(raw, 3)};
+        size_t shard = key[0] & (SHARDS - 1);
+        Shard& s = shards[shard];
+        std::unique_lock<std::mutex> lock = LockShard(s);
+
+        for (size_t probe = 0; probe < PROBE_WINDOW; ++probe) {
+            Slot& slot = SlotAt(shard, key[1], probe);
+            if (Matches(slot, key)) {
+                s.pinned += (level == ACTIVE) - (slot.level == ACTIVE);
+                slot.level = level;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Call f(raw, dows) for every entry. Writers of a shard wait while it is visited. */
+    template <typename F>
+    void ForEach(F f) const
+    {
+        if (!slots) {
+            return;
+        }
+        for (size_t shard = 0; shard < SHARDS; ++shard) {
+            std::lock_guard<std::mutex> lock(shards[shard].mutex);
+            for (size_t i = 0; i < per_shard; ++i) {
+                const Slot& slot = slots[shard * per_shard + i];
+                if (slot.seq.load(std::memory_order_relaxed) == 0) {
+                    continue;
+                }
+                uint256 raw, dows;
+                for (int j = 0; j < 4; ++j) {
+                    uint64_t k = slot.key[j].load(std::memory_order_relaxed);
+                    uint64_t v = slot.value[j].load(std::memory_order_relaxed);
+                    memcpy(raw.begin() + 8 * j, &k, 8);
+                    memcpy(dows.begin() + 8 * j, &v, 8);
+                }
+                f(raw, dows);
+            }
+        }
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        if (!slots) {
+            return stats;
+        }
+        for (size_t shard = 0; shard < SHARDS; ++shard) {
+            const Shard& s = shards[shard];
+            stats.hits += s.hits.load(std::memory_order_relaxed);
+            stats.misses += s.misses.load(std::memory_order_relaxed);
+            stats.inserts += s.inserts.load(std::memory_order_relaxed);
+            stats.contention += s.contention.load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(shards[shard].mutex);
+            stats.entries += s.entries;
+            stats.pinned += s.pinned;
+            stats.evictions += s.evictions;
+            stats.dropped += s.dropped;
+        }
+        stats.capacity = SHARDS * per_shard;
+        stats.usage = DynamicMemoryUsage();
+        return stats;
+    }
+};
+
+#endif // STHCOIN_DOWSCACHE_H
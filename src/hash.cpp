@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <hash.h>
+#include <arith_uint256.h>
 #include <crypto/common.h>
 #include <crypto/hmac_sha512.h>
 
@@ -13,17 +14,22 @@
 #include <map>
 #include <thread>
 #include <utiltime.h>
-#include <shutdown.h>
 #include <util.h>
 #include <clientversion.h>
 #include <streams.h>
 #include <sync.h>
+#include <random.h>
+#include <threadinterrupt.h>
 
 //#define LOG_HASH
 #ifdef  LOG_HASH
 #include <logging.h> // May fail at cross compilation for Windows
 #endif
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
 extern "C"
 {
 #include <lualib.h>
@@ -34,25 +40,38 @@ extern "C"
 #include <stdio.h>
 }
 
-#define MAX_STMT_NUM       12
 #define MIN_STMT_NUM       8
-#define FUNC_COUNT     16  // Number of functions in the hashing code
 #define OP_COUNT       10   // total number of operations
 #define CALL_WEIGHT    2   // the larger, the more likely function calls
 #define DOWS_HASH_CACHE_CHECKSUM_SIZE  8
+#define DOWS_CODE_SIZE  100000   // room for the longest program MakeHashCode() generates
+#define HASH_BASE_PREFETCH_DISTANCE  16   // hash base reads requested ahead of the one being hashed
 
 typedef std::array<char, 32> hash256_array;
 typedef std::array<char, DOWS_HASH_CACHE_CHECKSUM_SIZE> dows_hash_cache_checksum_t;
-typedef std::map<hash256_array, hash256_array> dows_hash_cache_t;
-extern CCriticalSection cs_main;
 
-static uint32_t g_hashBase[HASH_BASE_SIZE];  // Written only once at the beginning of the application
-std::atomic<bool> dowsHashLock(false);
-dows_hash_cache_t dowsHashCache;
-static const uint64_t DOWS_HASH_CACHE_VERSION = 1;
+static const uint32_t * g_hashBase = nullptr;  // Set once, by init or by the first DowsHash() that needs it
+static std::atomic<bool> g_hash_base_ready(false);
+static std::mutex g_hash_base_mutex;
+static CDowsHashCache dowsHashCache;
+static const uint64_t DOWS_HASH_CACHE_VERSION = 2;
+static const size_t DOWS_HASH_CACHE_RECORD_SIZE = 32 + 32 + DOWS_HASH_CACHE_CHECKSUM_SIZE;
+static const int64_t DOWS_HASH_CACHE_FLUSH_INTERVAL = 60;  // seconds between appends to hash.dat
+static const uint64_t DOWS_HASH_CACHE_COMPACT_SLACK = 100000;  // records
+static const size_t DOWS_HASH_CACHE_LOAD_CHUNK = 1 << 16;  // records read and verified at a time
+static const int DOWS_HASH_CACHE_LOAD_MAX_THREADS = 16;
+static const char HASH_BASE_FILE_MAGIC[8] = {'D', 'O', 'W', 'S', 'B', 'A', 'S', 'E'};
+static const uint64_t HASH_BASE_FILE_VERSION = 1;
+static const size_t HASH_BASE_FILE_HEADER_SIZE = 4096;  // keeps the table page aligned in the mapping
+static const int HASH_BASE_MAX_THREADS = 64;
 std::atomic_bool g_is_dows_hash_cache_loaded{false};
-std::chrono::time_point<std::chrono::system_clock> last_dows_cache_save_time;
 CCriticalSection cs_dows_cache_save;
+static uint64_t g_dows_cache_file_records GUARDED_BY(cs_dows_cache_save) = 0;
+static bool g_dows_cache_file_compact GUARDED_BY(cs_dows_cache_save) = true;
+static std::mutex g_dows_cache_pending_mutex;
+static std::vector<std::pair<uint256, uint256>> g_dows_cache_pending;  // computed since the last flush
+static CThreadInterrupt g_dows_cache_writer_interrupt;
+DowsEngine g_dows_engine = DowsEngine::NATIVE;
 
 // } + 
 
@@ -300,52 +319,53 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
 static inline uint32_t GetUint32FromHashBase (uint32_t i)
 {
   i = i % HASH_BASE_SIZE_IN_BYTES;
-  return ((uint32_t) ((uint8_t * ) g_hashBase)[i])
-         | (((uint32_t) ((uint8_t * ) g_hashBase)[(i + 1) % HASH_BASE_SIZE_IN_BYTES]) << 8)
-         | (((uint32_t) ((uint8_t * ) g_hashBase)[(i + 2) % HASH_BASE_SIZE_IN_BYTES]) << 16)
-         | (((uint32_t) ((uint8_t * ) g_hashBase)[(i + 3) % HASH_BASE_SIZE_IN_BYTES]) << 24);
+  return ((uint32_t) ((const uint8_t * ) g_hashBase)[i])
+         | (((uint32_t) ((const uint8_t * ) g_hashBase)[(i + 1) % HASH_BASE_SIZE_IN_BYTES]) << 8)
+         | (((uint32_t) ((const uint8_t * ) g_hashBase)[(i + 2) % HASH_BASE_SIZE_IN_BYTES]) << 16)
+         | (((uint32_t) ((const uint8_t * ) g_hashBase)[(i + 3) % HASH_BASE_SIZE_IN_BYTES]) << 24);
 }
 
-
-static int NotShift (lua_State *L)
+static inline void PrefetchUint32FromHashBase (uint32_t i)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t x =  (uint32_t) lua_tonumber(L,1);
-  uint32_t y =  (uint32_t) lua_tonumber(L,2);
-  uint32_t m =  (uint32_t) lua_tonumber(L,3);
-  uint32_t n =  (uint32_t) lua_tonumber(L,4);
+#if defined(__GNUC__)
+  __builtin_prefetch ((const uint8_t * ) g_hashBase + i % HASH_BASE_SIZE_IN_BYTES);
+#endif
+}
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
-  x = ~ (x + m);
-  x = (((x >> 3) | (x << 29)) - m);
-  y = ~ (y - n);
-  y = ((y >> 19) | (y << 13)) + n;
 
+// The DOWS primitives. Each one takes the (x, y) pair and the two prime
+// parameters of a statement and returns the new (x, y) pair in place. They
+// are shared by the Lua reference engine and the native engine.
+//
+// The four primitives that read the hash base do it in one place, as
+// DowsMixHashBase. They are split into a head before and a tail after it, so
+// that ShuffleHash256Lanes can prefetch the reads and switch to another hash
+// while they are in flight.
+
+static inline void DowsMixHashBase (uint32_t & x, uint32_t & y)
+{
   x = x ^ GetUint32FromHashBase(x);
   y = y ^ GetUint32FromHashBase(y);
+}
 
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
 
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
+static inline void DowsNotShiftHead (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
+{
+  x = ~ (x + m);
+  x = (((x >> 3) | (x << 29)) - m);
+  y = ~ (y - n);
+  y = ((y >> 19) | (y << 13)) + n;
 }
 
-
-static int AndXorOr (lua_State *L)
+static inline void DowsNotShift (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t m =  (uint32_t) lua_tonumber(L,3);
-  uint32_t n =  (uint32_t) lua_tonumber(L,4);
-  uint32_t x =  ((uint32_t) lua_tonumber(L,1)) - m;
-  uint32_t y =  ((uint32_t) lua_tonumber(L,2)) + n;
+  DowsNotShiftHead (x, y, m, n);
+  DowsMixHashBase (x, y);
+}
 
-  x = x ^ GetUint32FromHashBase(x);
-  y = y ^ GetUint32FromHashBase(y);
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
+static inline void DowsAndXorOrTail (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
+{
   uint32_t a, b, c, d;
   a = (x >> 16) & 0x0000FFFF;
   b = x & 0x0000FFFF;
@@ -354,26 +374,22 @@ static int AndXorOr (lua_State *L)
 
   x = ((((a & c) ^ (~ a & d)) << 16) | ((b & c) ^ (~ b & d))) + m;
   y = ((((c & a) ^ (~ c & b)) << 16) | ((d & a) ^ (~ d & b))) - n;
+}
 
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
+static inline void DowsAndXorOr (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
+{
+  x -= m;
+  y += n;
+  DowsMixHashBase (x, y);
+  DowsAndXorOrTail (x, y, m, n);
 }
 
 
-static int AndXor (lua_State *L)
+static inline void DowsAndXorHead (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t m =  (uint32_t) lua_tonumber(L,3);
-  uint32_t n =  (uint32_t) lua_tonumber(L,4);
-  uint32_t x =  ((uint32_t) lua_tonumber(L,1)) - m;
-  uint32_t y =  ((uint32_t) lua_tonumber(L,2)) + n;
+  x -= m;
+  y += n;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   uint32_t a, b, c, d;
   a = x & 0x0000FFFF;
   b = (x >> 16) & 0x0000FFFF;
@@ -382,107 +398,62 @@ static int AndXor (lua_State *L)
 
   x = ((((a & b) ^ (a & c) ^ (b & c)) << 16) |  ((b & c) ^ (b & d) ^ (c & d))) - m;
   y = ((((c & d) ^ (c & a) ^ (d & a)) << 16) |  ((d & a) ^ (d & b) ^ (a & b))) + n;
-
-  x = x ^ GetUint32FromHashBase(x);
-  y = y ^ GetUint32FromHashBase(y);
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
-static int ShiftXor (lua_State *L)
+static inline void DowsAndXor (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t m =  (uint32_t) lua_tonumber(L,3);
-  uint32_t n =  (uint32_t) lua_tonumber(L,4);
-  uint32_t x =  ((uint32_t) lua_tonumber(L,1)) - m;
-  uint32_t y =  ((uint32_t) lua_tonumber(L,2)) + n;
+  DowsAndXorHead (x, y, m, n);
+  DowsMixHashBase (x, y);
+}
 
-  x = x ^ GetUint32FromHashBase(x);
-  y = y ^ GetUint32FromHashBase(y);
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
+static inline void DowsShiftXorTail (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
+{
   x = (((x >> 2) | (x << 30)) ^ ((x >> 13) | (x << 19)) ^ ((x >> 22) | (x << 10))) + m;
   y = (((y >> 6) | (y << 26)) ^ ((y >> 11) | (y << 21)) ^ ((y >> 25) | (y << 7))) - n;
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
+static inline void DowsShiftXor (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n)
+{
+  x -= m;
+  y += n;
+  DowsMixHashBase (x, y);
+  DowsShiftXorTail (x, y, m, n);
+}
 
 
-static int ShiftMix16 (lua_State *L)
+static inline void DowsShiftMix16 (uint32_t & x, uint32_t & y, uint32_t u, uint32_t v)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t x, y;
   uint64_t n;
-  uint32_t u =  (uint32_t) lua_tonumber(L,3);
-  uint32_t v =  (uint32_t) lua_tonumber(L,4);
-  uint64_t a = ((uint64_t) lua_tonumber(L,1)) + (uint64_t) u;
-  uint64_t b = ((uint64_t) lua_tonumber(L,2)) - (uint64_t) v;
+  uint64_t a = ((uint64_t) x) + (uint64_t) u;
+  uint64_t b = ((uint64_t) y) - (uint64_t) v;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   n = (a << 32) | b;
   n = ((n >> 7) | (n << 57)) ^ ((n >> 47) | (n << 17)) ^ ((n >> 53) | (n << 11));
   x = ((uint32_t) ((n & 0x0000FFFF) + ((n >> 16) & 0xFFFF0000))) - u;
   y = ((uint32_t) (((n >> 16) & 0x0000FFFF) + ((n >> 32) & 0xFFFF0000))) + v;
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
 
-static int ShiftMix8 (lua_State *L)
+static inline void DowsShiftMix8 (uint32_t & x, uint32_t & y, uint32_t u, uint32_t v)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t x, y;
   uint64_t n;
-  uint32_t u =  (uint32_t) lua_tonumber(L,3);
-  uint32_t v =  (uint32_t) lua_tonumber(L,4);
-  uint64_t a = ((uint64_t) lua_tonumber(L,1)) - (uint64_t) u;
-  uint64_t b = ((uint64_t) lua_tonumber(L,2)) + (uint64_t) v;
+  uint64_t a = ((uint64_t) x) - (uint64_t) u;
+  uint64_t b = ((uint64_t) y) + (uint64_t) v;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   n = (b << 32) | a;
   n = ((n >> 19) | (n << 45)) ^ ((n >> 29) | (n << 35)) ^ ((n >> 59) | (n << 5));
   x = ((uint32_t) (((n & 0x000000FF) << 24) | ((n & 0x00FF0000) >> 8) | ((n >> 16) & 0x00FF0000) | ((n >> 48) & 0x000000FF))) + u;
   y = ((uint32_t) (((n & 0x0000FF00) << 16) | ((n & 0xFF000000) >> 8) | ((n >> 32) & 0x0000FF00) | (n >> 56))) - v;
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
 
-static int SwapShift (lua_State *L)
+static inline void DowsSwapShift (uint32_t & x, uint32_t & y, uint32_t s, uint32_t t)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t s =  (uint32_t) lua_tonumber(L,3);
-  uint32_t t =  (uint32_t) lua_tonumber(L,4);
-  uint32_t a =  (uint32_t) lua_tonumber(L,1) + s;
-  uint32_t b =  (uint32_t) lua_tonumber(L,2) - t;
-  uint32_t x, y, n;
+  uint32_t a = x + s;
+  uint32_t b = y - t;
+  uint32_t n;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   uint32_t c = a % 43;
   uint32_t d = b % 41;
 
@@ -510,62 +481,53 @@ static int SwapShift (lua_State *L)
   x = ((x >> c) | (x << (32 - c))) - s;
   y = ((a & v) | (b & u));
   y = ((y << d) | (y >> (32 - d))) + t;
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
 
-static int PrimeMix (lua_State *L)
+static inline void DowsPrimeMix (uint32_t & x, uint32_t & y, uint32_t u, uint32_t v)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t x, y;
   uint64_t n;
-  uint32_t u =  (uint32_t) lua_tonumber(L,3);
-  uint32_t v =  (uint32_t) lua_tonumber(L,4);
-  uint64_t a = ((uint64_t) lua_tonumber(L,1)) - (uint64_t) u;
-  uint64_t b = ((uint64_t) lua_tonumber(L,2)) + (uint64_t) v;
+  uint64_t a = ((uint64_t) x) - (uint64_t) u;
+  uint64_t b = ((uint64_t) y) + (uint64_t) v;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   n = (a << 32) | b;
   n = ((n >> 6) | (n << 58)) ^ ((n >> 47) | (n << 17)) ^ ((n >> 54) | (n << 10));
 
   x = ((uint32_t) (n % 257 + n / 65537 % 257 * 257 + n / 4294967291 % 257 * 65537 + n / 4294967291 / 65537 % 257 * 65537 * 257)) + u;
   n /= 257;
   y = ((uint32_t) (n % 257 + n / 65537 % 257 * 257 + n / 4294967291 % 257 * 65537 + n / 4294967291 / 65537 % 257 * 65537 * 257)) - v;
-
-  // Step 3:  Push the result on the lua stack.
-  lua_pushnumber(L,(double) x);
-  lua_pushnumber(L,(double) y);
-
-  // Return the number of arguments we pushed onto the stack (that is, the number of return values this
-  // function has
-  return 2;
 }
 
 
-static int PrimeMix2 (lua_State *L)
+static inline void DowsPrimeMix2 (uint32_t & x, uint32_t & y, uint32_t u, uint32_t v)
 {
-  // Step 1:  extract the parameters from the lua stack:
-  uint32_t x, y;
   uint64_t n;
-  uint32_t u =  (uint32_t) lua_tonumber(L,3);
-  uint32_t v =  (uint32_t) lua_tonumber(L,4);
-  uint64_t a = ((uint64_t) lua_tonumber(L,1)) + (uint64_t) u;
-  uint64_t b = ((uint64_t) lua_tonumber(L,2)) - (uint64_t) v;
+  uint64_t a = ((uint64_t) x) + (uint64_t) u;
+  uint64_t b = ((uint64_t) y) - (uint64_t) v;
 
-  //  Step 2:  Do the actual calculation.  Normally, this will be more interesting than a single sum!
   n = (a << 32) | b;
   n = ((n >> 8) | (n << 56)) ^ ((n >> 43) | (n << 21)) ^ ((n >> 52) | (n << 12));
 
   x = ((uint32_t) (n % 251 * 65539 * 251 + n / 65539 % 251 * 65539 + n / 4294967279 % 251 * 251 + n / 4294967279 / 65539 % 251)) - u;
   n = n / 251;
   y = ((uint32_t) (n % 251 * 65539 * 251 + n / 65539 % 251 * 65539 + n / 4294967279 % 251 * 251 + n / 4294967279 / 65539 % 251)) + v;
+}
+
+
+typedef void (* DowsPrimitive) (uint32_t & x, uint32_t & y, uint32_t m, uint32_t n);
+
+// Expose a primitive to the Lua reference engine as f(x, y, m, n) -> x, y
+template <DowsPrimitive F>
+static int LuaDowsPrimitive (lua_State *L)
+{
+  // Step 1:  extract the parameters from the lua stack:
+  uint32_t x =  (uint32_t) lua_tonumber(L,1);
+  uint32_t y =  (uint32_t) lua_tonumber(L,2);
+  uint32_t m =  (uint32_t) lua_tonumber(L,3);
+  uint32_t n =  (uint32_t) lua_tonumber(L,4);
+
+  //  Step 2:  Do the actual calculation.
+  F(x, y, m, n);
 
   // Step 3:  Push the result on the lua stack.
   lua_pushnumber(L,(double) x);
@@ -576,13 +538,20 @@ static int PrimeMix2 (lua_State *L)
   return 2;
 }
 
+// The primes of the "p" table in the generated code (Lua indices 1 to 97)
+static const uint32_t g_dowsPrimes[DOWS_PRIME_COUNT] = {145403341,66068741,2749919,27290089,34185863,37667459,95188969,13833949,67867831,71479897,78736303,55316783,162373177,141650737,149163137,82375961,22182247,126673831,23879353,12195067,108092819,109938481,18815059,60677941,41161511,171834121,177525619,143522779,160481023,62472941,80556551,20495749,10570697,98866763,69672541,25582019,53533379,32452657,84200113,48210583,30723547,75103313,113648273,179424551,91518881,147280787,97026073,46441099,121086289,168048611,7368631,137896123,64268657,8960299,139772119,76918057,122949667,87857347,130408657,104395003,158594087,166158541,29005411,5799961,73289599,154819559,134150869,128541643,106244773,102551369,175628303,117363863,169941001,164262793,111794677,100711231,58885829,93354587,1299553,132276563,57099149,115507703,152935751,15485761,136023631,49979591,39410737,44680193,119226883,86027987,173729729,51754847,156703873,124811003,42919973,89687537,35926171};
 
-void MakeHashCode (uint64_t seed, uint64_t incr, char * code)
+
+// Globals every generated program uses; a persistent Lua state sets them once
+static const char DOWS_CODE_GLOBALS[] = "f = {}\np = {145403341,66068741,2749919,27290089,34185863,37667459,95188969,13833949,67867831,71479897,78736303,55316783,162373177,141650737,149163137,82375961,22182247,126673831,23879353,12195067,108092819,109938481,18815059,60677941,41161511,171834121,177525619,143522779,160481023,62472941,80556551,20495749,10570697,98866763,69672541,25582019,53533379,32452657,84200113,48210583,30723547,75103313,113648273,179424551,91518881,147280787,97026073,46441099,121086289,168048611,7368631,137896123,64268657,8960299,139772119,76918057,122949667,87857347,130408657,104395003,158594087,166158541,29005411,5799961,73289599,154819559,134150869,128541643,106244773,102551369,175628303,117363863,169941001,164262793,111794677,100711231,58885829,93354587,1299553,132276563,57099149,115507703,152935751,15485761,136023631,49979591,39410737,44680193,119226883,86027987,173729729,51754847,156703873,124811003,42919973,89687537,35926171}\n";
+
+// Append the FUNC_COUNT functions of the program for seed and incr at end,
+// and return the new end of the code
+static char * MakeHashFunctions (uint64_t seed, uint64_t incr, char * end)
 {
-  char buf[1000];
-  char f[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I'};
+  static const char f[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I'};
   char call[1000];
-  sprintf (call, "\
+  const int callLength = sprintf (call, "\
                     if (r > 0) then \n\
                          if (x %% 23 < 12 and y %% 29 > 14) then\n\
                            z = ((x %% 71) + (y %% 19)) %% %u\n\
@@ -595,44 +564,266 @@ void MakeHashCode (uint64_t seed, uint64_t incr, char * code)
   CPCG32 pcg32 (seed, incr);
 
   int i, j, n;
-  sprintf (code, "f = {}\n");
-  strcat (code, "p = {145403341,66068741,2749919,27290089,34185863,37667459,95188969,13833949,67867831,71479897,78736303,55316783,162373177,141650737,149163137,82375961,22182247,126673831,23879353,12195067,108092819,109938481,18815059,60677941,41161511,171834121,177525619,143522779,160481023,62472941,80556551,20495749,10570697,98866763,69672541,25582019,53533379,32452657,84200113,48210583,30723547,75103313,113648273,179424551,91518881,147280787,97026073,46441099,121086289,168048611,7368631,137896123,64268657,8960299,139772119,76918057,122949667,87857347,130408657,104395003,158594087,166158541,29005411,5799961,73289599,154819559,134150869,128541643,106244773,102551369,175628303,117363863,169941001,164262793,111794677,100711231,58885829,93354587,1299553,132276563,57099149,115507703,152935751,15485761,136023631,49979591,39410737,44680193,119226883,86027987,173729729,51754847,156703873,124811003,42919973,89687537,35926171}\n");
   for (i = 0; i < FUNC_COUNT; ++ i) {
-    sprintf (buf, "f[%u] = function (x, y, r)\nlocal z\n", i);
-    strcat (code, buf);
+    end += sprintf (end, "f[%u] = function (x, y, r)\nlocal z\n", i);
     n = pcg32.randint(MIN_STMT_NUM, MAX_STMT_NUM);
     for (j = 0; j < n; ++ j) {
       int k = pcg32.pcg32 () % (OP_COUNT + CALL_WEIGHT);
       if (k <= OP_COUNT - 2) {
-        sprintf(buf, "y, x = %c (x, y, p[y %% 97 + 1], p[(x + 48) %% 97 + 1])\n", f[k]);
-        strcat(code, buf);
+        end += sprintf (end, "y, x = %c (x, y, p[y %% 97 + 1], p[(x + 48) %% 97 + 1])\n", f[k]);
         continue;
       }
-      strcat (code, call);
+      memcpy (end, call, callLength + 1);
+      end += callLength;
     }
-    strcat (code, "return y, x\nend\n\n");
+    end += sprintf (end, "return y, x\nend\n\n");
   }
+  return end;
+}
+
+void MakeHashCode (uint64_t seed, uint64_t incr, char * code)
+{
+  memcpy (code, DOWS_CODE_GLOBALS, sizeof(DOWS_CODE_GLOBALS));
+  MakeHashFunctions (seed, incr, code + sizeof(DOWS_CODE_GLOBALS) - 1);
 }
 
 
-void InitHashBase () {
+// Decode the same PCG-driven statement sequence as MakeHashCode into an op
+// table for the native engine. Both must consume the PCG stream identically.
+void MakeHashProgram (uint64_t seed, uint64_t incr, DowsProgram & program)
+{
+  CPCG32 pcg32 (seed, incr);
+
+  int i, j, n;
+  for (i = 0; i < FUNC_COUNT; ++ i) {
+    n = pcg32.randint(MIN_STMT_NUM, MAX_STMT_NUM);
+    program.stmtCount[i] = (uint8_t) n;
+    for (j = 0; j < n; ++ j) {
+      int k = pcg32.pcg32 () % (OP_COUNT + CALL_WEIGHT);
+      program.stmts[i][j] = (k <= OP_COUNT - 2) ? (uint8_t) k : DOWS_OP_CALL;
+    }
+  }
+}
+
+
+static void FillHashBaseRange (uint32_t * base, uint32_t begin, uint32_t end, std::atomic<uint32_t> & done)
+{
   CPCG32 pcg32 (599128178199824553ull, 2055286011627441373ull);
+  pcg32.advance(begin);
 
   uint32_t i;
 
-  for (i = 0; i < HASH_BASE_SIZE; ++ i) {
-    uint8_t * p = (uint8_t *) &(g_hashBase[i]);
+  for (i = begin; i < end; ++ i) {
+    uint8_t * p = (uint8_t *) &(base[i]);
     uint32_t r = pcg32.pcg32();
     p[0] = (uint8_t) (r & 0x000000FF);
     p[1] = (uint8_t) ((r >> 8) & 0x000000FF);
     p[2] = (uint8_t) ((r >> 16) & 0x000000FF);
     p[3] = (uint8_t) ((r >> 24) & 0x000000FF);
+    if (((i - begin) & 0xFFFFF) == 0xFFFFF) {
+      done.fetch_add(0x100000, std::memory_order_relaxed);
+    }
+  }
+  done.fetch_add((end - begin) & 0xFFFFF, std::memory_order_relaxed);
+}
+
+// The table is one PCG stream. Each thread jumps ahead to the start of its
+// own slice, so the bytes do not depend on the number of threads.
+static void FillHashBase (uint32_t * base, const std::function<void(int)> & progress)
+{
+  int threads = std::max(1, std::min(GetNumCores(), HASH_BASE_MAX_THREADS));
+  uint32_t slice = HASH_BASE_SIZE / threads + 1;
+  std::atomic<uint32_t> done(0);
+  std::vector<std::thread> workers;
+
+  LogPrintf("Generating hash base using %d threads\n", threads);
+  for (int t = 0; t < threads; ++ t) {
+    uint32_t begin = std::min(HASH_BASE_SIZE, slice * t);
+    uint32_t end = std::min(HASH_BASE_SIZE, begin + slice);
+    workers.emplace_back(FillHashBaseRange, base, begin, end, std::ref(done));
+  }
+
+  int last = -1;
+  while (progress && done.load(std::memory_order_relaxed) < HASH_BASE_SIZE) {
+    int percent = (int) ((uint64_t) done.load(std::memory_order_relaxed) * 100 / HASH_BASE_SIZE);
+    if (percent != last) {
+      progress(percent);
+      last = percent;
+    }
+    MilliSleep(100);
+  }
+  for (std::thread & worker : workers) {
+    worker.join();
+  }
+  if (progress) {
+    progress(100);
+  }
+}
+
+// Cheap checksum to detect truncated or damaged hash base files. Four
+// independent FNV-1a lanes over the 32-bit words keep it memory bound.
+static uint64_t HashBaseChecksum (const uint32_t * base)
+{
+  const uint8_t * p = (const uint8_t *) base;
+  uint64_t lanes[4] = {0xcbf29ce484222325ull, 0xcbf29ce484222325ull, 0xcbf29ce484222325ull, 0xcbf29ce484222325ull};
+
+  for (uint32_t i = 0; i < HASH_BASE_SIZE; ++ i) {
+    uint64_t & lane = lanes[i & 3];
+    lane = (lane ^ ReadLE32(p + 4 * (size_t) i)) * 0x100000001b3ull;
+  }
+  return lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+}
+
+static uint32_t * AllocateHashBase (bool hugepages)
+{
+#ifndef WIN32
+  void * p = mmap(nullptr, HASH_BASE_SIZE_IN_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+#ifdef MADV_HUGEPAGE
+  if (hugepages) {
+    madvise(p, HASH_BASE_SIZE_IN_BYTES, MADV_HUGEPAGE);
+  }
+#endif
+  return (uint32_t *) p;
+#else
+  return new (std::nothrow) uint32_t[HASH_BASE_SIZE];
+#endif
+}
+
+static void WriteHashBaseFileHeader (unsigned char * header, uint64_t checksum)
+{
+  memset(header, 0, HASH_BASE_FILE_HEADER_SIZE);
+  memcpy(header, HASH_BASE_FILE_MAGIC, sizeof(HASH_BASE_FILE_MAGIC));
+  WriteLE64(header + 8, HASH_BASE_FILE_VERSION);
+  WriteLE64(header + 16, HASH_BASE_SIZE_IN_BYTES);
+  WriteLE64(header + 24, checksum);
+}
+
+static bool WriteHashBaseFile (const fs::path & file, const uint32_t * base)
+{
+  unsigned char header[HASH_BASE_FILE_HEADER_SIZE];
+  WriteHashBaseFileHeader(header, HashBaseChecksum(base));
+
+  // Write under a private name so that nodes starting together do not clash
+  fs::path tmp = file.string() + strprintf(".%08x.new", GetRand(std::numeric_limits<uint32_t>::max()));
+  FILE * f = fsbridge::fopen(tmp, "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+            && fwrite(base, 1, HASH_BASE_SIZE_IN_BYTES, f) == HASH_BASE_SIZE_IN_BYTES
+            && FileCommit(f);
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || !RenameOver(tmp, file)) {
+    fs::remove(tmp);
+    return false;
+  }
+  return true;
+}
+
+// Map a hash base file written by WriteHashBaseFile read-only, so that all
+// processes on the host share one page cache copy of it.
+static const uint32_t * MapHashBaseFile (const fs::path & file, bool populate, bool hugepages)
+{
+  FILE * f = fsbridge::fopen(file, "rb");
+  if (!f) {
+    return nullptr;
   }
+
+  unsigned char header[HASH_BASE_FILE_HEADER_SIZE], expected[HASH_BASE_FILE_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), f) != sizeof(header)) {
+    fclose(f);
+    return nullptr;
+  }
+  uint64_t checksum = ReadLE64(header + 24);
+  WriteHashBaseFileHeader(expected, checksum);
+  if (memcmp(header, expected, sizeof(header)) != 0) {
+    fclose(f);
+    return nullptr;
+  }
+
+#ifndef WIN32
+  const size_t length = HASH_BASE_FILE_HEADER_SIZE + (size_t) HASH_BASE_SIZE_IN_BYTES;
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (populate) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+  void * p = mmap(nullptr, length, PROT_READ, flags, fileno(f), 0);
+  fclose(f);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+#ifdef MADV_HUGEPAGE
+  if (hugepages) {
+    madvise(p, length, MADV_HUGEPAGE);
+  }
+#endif
+  const uint32_t * base = (const uint32_t *) ((const unsigned char *) p + HASH_BASE_FILE_HEADER_SIZE);
+  if (HashBaseChecksum(base) != checksum) {
+    munmap(p, length);
+    return nullptr;
+  }
+  // DOWS reads the table at random; read-ahead would only waste page cache
+  madvise(p, length, MADV_RANDOM);
+  return base;
+#else
+  uint32_t * base = AllocateHashBase(hugepages);
+  bool ok = base && fread(base, 1, HASH_BASE_SIZE_IN_BYTES, f) == HASH_BASE_SIZE_IN_BYTES;
+  fclose(f);
+  if (!ok || HashBaseChecksum(base) != checksum) {
+    delete[] base;
+    return nullptr;
+  }
+  return base;
+#endif
+}
+
+bool InitHashBase (const std::string & file, bool populate, bool hugepages, const std::function<void(int)> & progress)
+{
+  std::lock_guard<std::mutex> lock(g_hash_base_mutex);
+  if (g_hash_base_ready.load(std::memory_order_acquire)) {
+    return true;
+  }
+
+  int64_t start = GetTimeMicros();
+  fs::path path(file);
+  if (!file.empty() && fs::exists(path)) {
+    const uint32_t * base = MapHashBaseFile(path, populate, hugepages);
+    if (base) {
+      g_hashBase = base;
+      g_hash_base_ready.store(true, std::memory_order_release);
+      LogPrintf("Mapped hash base from %s: %gs\n", path.string(), (GetTimeMicros() - start) * 0.000001);
+      return true;
+    }
+    LogPrintf("Hash base file %s is invalid, regenerating it\n", path.string());
+  }
+
+  uint32_t * base = AllocateHashBase(hugepages);
+  if (!base) {
+    return false;
+  }
+  FillHashBase(base, progress);
+  g_hashBase = base;
+  g_hash_base_ready.store(true, std::memory_order_release);
+  LogPrintf("Generated hash base: %gs\n", (GetTimeMicros() - start) * 0.000001);
+
+  if (!file.empty()) {
+    if (WriteHashBaseFile(path, base)) {
+      LogPrintf("Wrote hash base to %s\n", path.string());
+    } else {
+      LogPrintf("Failed to write hash base to %s. Continuing anyway.\n", path.string());
+    }
+  }
+  return true;
 }
 
 
 // Get the 64-bit number from bits starting at byte of index i
-inline uint64_t GetUint64 (uint8_t * bits, uint32_t i)
+inline uint64_t GetUint64 (const uint8_t * bits, uint32_t i)
 {
   uint64_t x = ((uint64_t) bits[i % 32]) << 56;
   x |= ((uint64_t) bits[(i + 1) % 32]) << 48;
@@ -647,165 +838,649 @@ inline uint64_t GetUint64 (uint8_t * bits, uint32_t i)
 }
 
 
-void ShuffleHash256 (lua_State * L, uint8_t * hash)
+// Steps of the shuffle driver: two passes over the eight 4-byte words of the
+// hash, each step calling function f of the program r times on the word pair
+// at byte m with recursion budget d, then writing the pair back
+#define DOWS_SHUFFLE_STEPS  16
+
+static inline void DowsShuffleLoad (const uint8_t * hash, uint32_t m, uint32_t & x, uint32_t & y, uint32_t & f, uint32_t & r, uint32_t & d)
 {
   const uint32_t byteNum = 32;
+  uint32_t n = (m + 4) % byteNum;
+  uint32_t k = (n + 4) % byteNum;
+
+  x = (((uint32_t) hash[m]) << 24) + (((uint32_t) hash[(m + 1) % byteNum]) << 16)
+      + (((uint32_t) hash[(m + 2) % byteNum]) << 8) + (uint32_t) hash[(m + 3) % byteNum];
+  y = (((uint32_t) hash[(n + 3) % byteNum]) << 24) + (((uint32_t) hash[(n + 2) % byteNum]) << 16)
+      + (((uint32_t) hash[(n + 1) % byteNum]) << 8) + (uint32_t) hash[n];
+  f = (hash[k] >> 4) & 0x0F;
+  r = ((hash[k] >> 2) & 0x03) + 1;
+  d = (hash[k] & 0x03) + 2;
+}
 
-  for (uint32_t i = 0; i < 2; ++ i) {
-    for (uint32_t m = 0; m < byteNum; m += 4) {
-      uint32_t x, y, n, k, f, r, d;
-      n = (m + 4) % byteNum;
-      k = (n + 4) % byteNum;
-
-      x = (((uint32_t) hash[m]) << 24) + (((uint32_t) hash[(m + 1) % byteNum]) << 16)
-          + (((uint32_t) hash[(m + 2) % byteNum]) << 8) + (uint32_t) hash[(m + 3) % byteNum];
-      y = (((uint32_t) hash[(n + 3) % byteNum]) << 24) + (((uint32_t) hash[(n + 2) % byteNum]) << 16)
-          + (((uint32_t) hash[(n + 1) % byteNum]) << 8) + (uint32_t) hash[n];
-      f = (hash[k] >> 4) & 0x0F;
-      r = ((hash[k] >> 2) & 0x03) + 1;
-      d = (hash[k] & 0x03) + 2;
-
-      for (uint32_t k = 0; k < r; ++k) {
-        lua_getglobal(L, "f");
-        lua_pushnumber(L, f);
-        lua_gettable(L, -2);
-        lua_remove(L, -2);
-        lua_pushnumber(L, x);
-        lua_pushnumber(L, y);
-        lua_pushnumber(L, d);
-        if (lua_pcall(L, 3, 2, 0) == 0) {
-          x = lua_tointeger(L, -2);
-          y = lua_tointeger(L, -1);
-          lua_pop(L, 2);
-        }
-        else {
+static inline void DowsShuffleStore (uint8_t * hash, uint32_t m, uint32_t x, uint32_t y)
+{
+  const uint32_t byteNum = 32;
+  uint32_t n = (m + 4) % byteNum;
+
+  hash[m] = (uint8_t)((x >> 24) & 0x000000FF);
+  hash[(m + 1) % byteNum] = (uint8_t)((x >> 16) & 0x000000FF);
+  hash[(m + 2) % byteNum] = (uint8_t)((x >> 8) & 0x000000FF);
+  hash[(m + 3) % byteNum] = (uint8_t)(x & 0x000000FF);
+  hash[(n + 3) % byteNum] = (uint8_t)((y >> 24) & 0x000000FF);
+  hash[(n + 2) % byteNum] = (uint8_t)((y >> 16) & 0x000000FF);
+  hash[(n + 1) % byteNum] = (uint8_t)((y >> 8) & 0x000000FF);
+  hash[n] = (uint8_t)(y & 0x000000FF);
+}
+
+// Shared driver of both engines. call(f, x, y, d) evaluates "x, y = f[f] (x, y, d)"
+// the way the Lua driver reads the results back.
+template <typename Call>
+static void ShuffleHash256Impl (uint8_t * hash, Call call)
+{
+  for (uint32_t s = 0; s < DOWS_SHUFFLE_STEPS; ++ s) {
+    uint32_t m = (s * 4) % 32;
+    uint32_t x, y, f, r, d;
+    DowsShuffleLoad (hash, m, x, y, f, r, d);
+
+    for (uint32_t k = 0; k < r; ++k) {
+      call(f, x, y, d);
+    }
+
+    DowsShuffleStore (hash, m, x, y);
+  }
+}
+
+void ShuffleHash256 (lua_State * L, uint8_t * hash)
+{
+  ShuffleHash256Impl (hash, [L] (uint32_t f, uint32_t & x, uint32_t & y, uint32_t d) {
+    lua_getglobal(L, "f");
+    lua_pushnumber(L, f);
+    lua_gettable(L, -2);
+    lua_remove(L, -2);
+    lua_pushnumber(L, x);
+    lua_pushnumber(L, y);
+    lua_pushnumber(L, d);
+    if (lua_pcall(L, 3, 2, 0) == 0) {
+      x = lua_tointeger(L, -2);
+      y = lua_tointeger(L, -1);
+      lua_pop(L, 2);
+    }
+    else {
 #ifdef  LOG_HASH
-          LogPrintf ("LUA error in ShuffleHash256: %s\n", lua_tostring(L, -1));
+      LogPrintf ("LUA error in ShuffleHash256: %s\n", lua_tostring(L, -1));
 #endif
-          lua_pop(L, 1);
+      lua_pop(L, 1);
+    }
+  });
+}
+
+
+// Run function i of a decoded program on (x, y) with recursion budget r. On
+// return x and y hold the callee's locals, i.e. what "y, x = f[i] (x, y, r)"
+// assigns in the generated code.
+static void RunHashFunction (const DowsProgram & program, uint32_t i, uint32_t & x, uint32_t & y, uint32_t r)
+{
+  for (uint32_t j = 0; j < program.stmtCount[i]; ++ j) {
+    uint8_t op = program.stmts[i][j];
+    if (op == DOWS_OP_CALL) {
+      if (r > 0) {
+        uint32_t z;
+        if (x % 23 < 12 && y % 29 > 14) {
+          z = ((x % 71) + (y % 19)) % FUNC_COUNT;
+        }
+        else {
+          z = ((x % 23) + (y % 67)) % FUNC_COUNT;
         }
+        RunHashFunction (program, z, x, y, r - 1);
       }
+      continue;
+    }
 
-      hash[m] = (uint8_t)((x >> 24) & 0x000000FF);
-      hash[(m + 1) % byteNum] = (uint8_t)((x >> 16) & 0x000000FF);
-      hash[(m + 2) % byteNum] = (uint8_t)((x >> 8) & 0x000000FF);
-      hash[(m + 3) % byteNum] = (uint8_t)(x & 0x000000FF);
-      hash[(n + 3) % byteNum] = (uint8_t)((y >> 24) & 0x000000FF);
-      hash[(n + 2) % byteNum] = (uint8_t)((y >> 16) & 0x000000FF);
-      hash[(n + 1) % byteNum] = (uint8_t)((y >> 8) & 0x000000FF);
-      hash[n] = (uint8_t)(y & 0x000000FF);
+    // Lua computes the indices on doubles, so x + 48 must not wrap
+    uint32_t m = g_dowsPrimes[y % DOWS_PRIME_COUNT];
+    uint32_t n = g_dowsPrimes[((uint64_t) x + 48) % DOWS_PRIME_COUNT];
+    switch (op) {
+      case 0: DowsNotShift (x, y, m, n); break;
+      case 1: DowsAndXor (x, y, m, n); break;
+      case 2: DowsAndXorOr (x, y, m, n); break;
+      case 3: DowsShiftMix8 (x, y, m, n); break;
+      case 4: DowsShiftMix16 (x, y, m, n); break;
+      case 5: DowsShiftXor (x, y, m, n); break;
+      case 6: DowsSwapShift (x, y, m, n); break;
+      case 7: DowsPrimeMix (x, y, m, n); break;
+      case 8: DowsPrimeMix2 (x, y, m, n); break;
     }
+    // "y, x = A (x, y, ...)" swaps the pair returned by the primitive
+    std::swap (x, y);
   }
 }
 
-inline void GetDowsHashCacheLock ()
+void ShuffleHash256 (const DowsProgram & program, uint8_t * hash)
 {
-    for (;;) {
-        auto old = dowsHashLock.exchange(true);
-        if (! old) return;
-    }
+  ShuffleHash256Impl (hash, [&program] (uint32_t f, uint32_t & x, uint32_t & y, uint32_t d) {
+    RunHashFunction (program, f, x, y, d);
+    // The driver reads the "return y, x" results back as x, y
+    std::swap (x, y);
+  });
 }
 
-uint256 DowsHash(uint256 result, bool debug, bool test)
+
+// Deepest call chain of a program: the driver's call with budget d <= 5 plus
+// one nested call per unit of budget
+#define DOWS_MAX_CALL_DEPTH  6
+
+// ShuffleHash256 of one program, unrolled into an explicit call stack so that
+// it can stop at any hash base read and resume later
+struct DowsShuffleLane
 {
-#ifdef  LOG_HASH
-  if (debug) {
-        LogPrint(BCLog::HASH, "Plain hash = %s\n", result.ToString());
+  struct Frame {
+    uint8_t func;   // function of the program being run
+    uint8_t stmt;   // next statement of it
+    uint8_t budget; // r of RunHashFunction
+  };
+
+  const DowsProgram * program;
+  uint8_t * hash;
+  uint32_t step;    // driver step, up to DOWS_SHUFFLE_STEPS
+  uint32_t call;    // driver calls of function f made in this step, up to calls
+  uint32_t calls, f, d;
+  uint32_t x, y;
+  uint32_t m, n;    // prime parameters of the pending statement
+  uint8_t pending;  // primitive waiting for its hash base reads, or DOWS_OP_CALL for none
+  int depth;
+  Frame stack[DOWS_MAX_CALL_DEPTH];
+
+  void Start (uint32_t s)
+  {
+    step = s;
+    if (step < DOWS_SHUFFLE_STEPS) {
+      DowsShuffleLoad (hash, (step * 4) % 32, x, y, f, calls, d);
+      call = 0;
+      Push (f, d);
     }
-#endif
+  }
 
-  uint256 rawHash;
+  void Push (uint32_t func, uint32_t budget)
+  {
+    stack[depth].func = (uint8_t) func;
+    stack[depth].stmt = 0;
+    stack[depth].budget = (uint8_t) budget;
+    ++ depth;
+  }
 
-  if (! test) {
-      hash256_array rawHashArray;
+  // Run until the next hash base read has been prefetched or the shuffle is
+  // done; returns false once it is done
+  bool Run (void)
+  {
+    if (pending != DOWS_OP_CALL) {
+      DowsMixHashBase (x, y);
+      switch (pending) {
+        case 2: DowsAndXorOrTail (x, y, m, n); break;
+        case 5: DowsShiftXorTail (x, y, m, n); break;
+      }
+      std::swap (x, y);
+      pending = DOWS_OP_CALL;
+    }
 
-      memcpy(rawHashArray.data(), result.begin(), 32);
-      memcpy(rawHash.begin(), result.begin(), 32);
-      GetDowsHashCacheLock();
+    while (step < DOWS_SHUFFLE_STEPS) {
+      Frame & frame = stack[depth - 1];
+      if (frame.stmt == program->stmtCount[frame.func]) {
+        if (-- depth > 0) {
+          continue;
+        }
+        // The driver reads the "return y, x" results back as x, y
+        std::swap (x, y);
+        if (++ call < calls) {
+          Push (f, d);
+          continue;
+        }
+        DowsShuffleStore (hash, (step * 4) % 32, x, y);
+        Start (step + 1);
+        continue;
+      }
 
-      // If the DOWS hash is in the cache, use it instead of recalculation
+      uint8_t op = program->stmts[frame.func][frame.stmt ++];
+      if (op == DOWS_OP_CALL) {
+        if (frame.budget > 0) {
+          uint32_t z;
+          if (x % 23 < 12 && y % 29 > 14) {
+            z = ((x % 71) + (y % 19)) % FUNC_COUNT;
+          }
+          else {
+            z = ((x % 23) + (y % 67)) % FUNC_COUNT;
+          }
+          Push (z, frame.budget - 1);
+        }
+        continue;
+      }
 
-      auto r = dowsHashCache.find(rawHashArray);
-      dowsHashLock.store(false);
+      // Lua computes the indices on doubles, so x + 48 must not wrap
+      m = g_dowsPrimes[y % DOWS_PRIME_COUNT];
+      n = g_dowsPrimes[((uint64_t) x + 48) % DOWS_PRIME_COUNT];
+      switch (op) {
+        case 0: DowsNotShiftHead (x, y, m, n); break;
+        case 1: DowsAndXorHead (x, y, m, n); break;
+        case 2: x -= m; y += n; break;
+        case 5: x -= m; y += n; break;
+        case 3: DowsShiftMix8 (x, y, m, n); std::swap (x, y); continue;
+        case 4: DowsShiftMix16 (x, y, m, n); std::swap (x, y); continue;
+        case 6: DowsSwapShift (x, y, m, n); std::swap (x, y); continue;
+        case 7: DowsPrimeMix (x, y, m, n); std::swap (x, y); continue;
+        case 8: DowsPrimeMix2 (x, y, m, n); std::swap (x, y); continue;
+      }
+      PrefetchUint32FromHashBase (x);
+      PrefetchUint32FromHashBase (y);
+      pending = op;
+      return true;
+    }
+    return false;
+  }
+};
 
-      if (r != dowsHashCache.end()) {
-#ifdef  LOG_HASH
-          LogPrint(BCLog::HASH, "DOWS hash found in cache for %s\n", result.ToString());
-#endif
-          memcpy(result.begin(), r->second.data(), 32);
-          return result;
+void ShuffleHash256Lanes (const DowsProgram * programs, uint8_t * const * hashes, size_t count)
+{
+  // Shuffles differ a lot in length, so a lane that finishes takes the next
+  // one waiting instead of leaving the others to run on alone
+  DowsShuffleLane lane[DOWS_BATCH_LANES];
+  size_t next = 0;
+  int running = 0;
+  auto fill = [&] (DowsShuffleLane & l) {
+    l.program = &programs[next];
+    l.hash = hashes[next];
+    l.pending = DOWS_OP_CALL;
+    l.depth = 0;
+    l.Start (0);
+    ++ next;
+  };
+  while (running < DOWS_BATCH_LANES && next < count) {
+    fill (lane[running ++]);
+  }
+
+  // Round robin over the lanes still running; each one leaves a prefetched
+  // read behind that has the other lanes' turns to arrive
+  while (running > 0) {
+    for (int l = 0; l < running; ) {
+      if (lane[l].Run ()) {
+        ++ l;
+      }
+      else if (next < count) {
+        fill (lane[l]);
       }
-#ifdef  LOG_HASH
       else {
-          LogPrint(BCLog::HASH, "DOWS hash not in cache for %s\n", result.ToString());
+        std::swap (lane[l], lane[-- running]);
       }
-#endif
+    }
   }
+}
 
-  uint8_t h[32];
-  char code[100000];
-  int i;
-
-  memcpy (h, result.begin(), 32);
-  lua_State* L = luaL_newstate();
+bool ParseDowsEngine (const std::string & name, DowsEngine & engine)
+{
+    if (name == "native") {
+        engine = DowsEngine::NATIVE;
+    } else if (name == "lua") {
+        engine = DowsEngine::LUA;
+    } else if (name == "check") {
+        engine = DowsEngine::CHECK;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-  // load Lua base libraries (print / math / etc)
-  luaL_openlibs(L);
-  lua_register(L, "A", NotShift);
-  lua_register(L, "B", AndXor);
-  lua_register(L, "C", AndXorOr);
-  lua_register(L, "D", ShiftMix8);
-  lua_register(L, "E", ShiftMix16);
-  lua_register(L, "F", ShiftXor);
-  lua_register(L, "G", SwapShift);
-  lua_register(L, "H", PrimeMix);
-  lua_register(L, "I", PrimeMix2);
-
-
-  uint64_t seed = 0, incr = 0;
-  for (i = 0; i < 32; i += 4) {
+void DowsMixSeed (const uint8_t * h, uint64_t & seed, uint64_t & incr)
+{
+  for (int i = 0; i < 32; i += 4) {
     seed += GetUint64(h, i);
     incr += GetUint64(h, 31 - i);
     CPCG32 pcg32 (seed, incr);
     seed += (uint64_t) pcg32.pcg32();
   }
+}
+
+lua_State * NewDowsLuaState (void)
+{
+  lua_State* L = luaL_newstate();
+
+  // load Lua base libraries (print / math / etc)
+  luaL_openlibs(L);
+  lua_register(L, "A", LuaDowsPrimitive<DowsNotShift>);
+  lua_register(L, "B", LuaDowsPrimitive<DowsAndXor>);
+  lua_register(L, "C", LuaDowsPrimitive<DowsAndXorOr>);
+  lua_register(L, "D", LuaDowsPrimitive<DowsShiftMix8>);
+  lua_register(L, "E", LuaDowsPrimitive<DowsShiftMix16>);
+  lua_register(L, "F", LuaDowsPrimitive<DowsShiftXor>);
+  lua_register(L, "G", LuaDowsPrimitive<DowsSwapShift>);
+  lua_register(L, "H", LuaDowsPrimitive<DowsPrimeMix>);
+  lua_register(L, "I", LuaDowsPrimitive<DowsPrimeMix2>);
+  return L;
+}
+
+static std::atomic<uint64_t> g_dows_program_hits(0);
+static std::atomic<uint64_t> g_dows_program_misses(0);
+
+/**
+ * What a thread reuses from one DOWS hash to the next: the code buffer, a Lua
+ * state with the primitives and the globals of DOWS_CODE_GLOBALS set up once,
+ * and the DOWS_PROGRAM_CACHE_SIZE programs it used last, keyed by (seed, incr).
+ * Each slot holds the decoded program for the native engine and, once the Lua
+ * engine has run it, the compiled f table in the registry table of the state.
+ * Headers hashed again after they left the DOWS hash cache, e.g. by
+ * verifychain or on a reorg, skip generating and compiling their program.
+ */
+class DowsContext
+{
+public:
+  char code[DOWS_CODE_SIZE];
+  DowsProgram program;
+
+  static DowsContext & Get (void)
+  {
+    static thread_local DowsContext context;
+    return context;
+  }
+
+  lua_State * Lua (void)
+  {
+    if (! L) {
+      L = NewDowsLuaState();
+      luaL_loadstring(L, DOWS_CODE_GLOBALS);
+      lua_pcall(L, 0, 0, 0);
+      lua_newtable(L);
+      lua_setfield(L, LUA_REGISTRYINDEX, "dows_programs");
+      lua_settop(L, 0);
+    }
+    return L;
+  }
+
+  // The decoded program for seed and incr, from the cache if cache is set
+  const DowsProgram & NativeProgram (uint64_t seed, uint64_t incr, bool cache)
+  {
+    if (! cache) {
+      MakeHashProgram(seed, incr, program);
+      return program;
+    }
+    bool found;
+    Slot & slot = Lookup(seed, incr, found);
+    Count(found);
+    return slot.program;
+  }
+
+  // Point the global f of the Lua state at the compiled functions of the
+  // program for seed and incr, from the cache if cache is set
+  void LoadLuaProgram (uint64_t seed, uint64_t incr, bool cache)
+  {
+    lua_State * L = Lua();
+    bool found = false;
+    Slot * slot = cache ? &Lookup(seed, incr, found) : nullptr;
+    if (slot) {
+      Count(found && slot->lua);
+    }
+    if (slot && slot->lua) {
+      lua_getfield(L, LUA_REGISTRYINDEX, "dows_programs");
+      lua_rawgeti(L, -1, slot - slots + 1);
+      lua_setglobal(L, "f");
+      lua_settop(L, 0);
+      return;
+    }
+
+    // A fresh f, so that a cached table is never overwritten
+    lua_newtable(L);
+    lua_setglobal(L, "f");
+    MakeHashFunctions(seed, incr, code);
+    luaL_loadstring(L, code);
+    if (lua_pcall (L, 0, 0, 0)) {
+#ifdef  LOG_HASH
+      LogPrintf ("LUA error: %s\n", lua_tostring(L, -1));
+#endif
+      lua_pop(L, 1);
+    }
+    else if (slot) {
+      lua_getfield(L, LUA_REGISTRYINDEX, "dows_programs");
+      lua_getglobal(L, "f");
+      lua_rawseti(L, -2, slot - slots + 1);
+      slot->lua = true;
+    }
+    lua_settop(L, 0);
+  }
+
+  ~DowsContext()
+  {
+    if (L) {
+      lua_close(L);
+    }
+  }
+
+private:
+  struct Slot {
+    uint64_t seed = 0;
+    uint64_t incr = 0;
+    uint64_t used = 0;  // value of clock at the last use, 0 while empty
+    bool lua = false;   // whether the registry holds the compiled f table
+    DowsProgram program;
+  };
+
+  // The slot of seed and incr. If there is none, the least recently used slot
+  // is taken over and gets the decoded program.
+  Slot & Lookup (uint64_t seed, uint64_t incr, bool & found)
+  {
+    Slot * victim = &slots[0];
+    for (Slot & slot : slots) {
+      if (slot.used && slot.seed == seed && slot.incr == incr) {
+        slot.used = ++ clock;
+        found = true;
+        return slot;
+      }
+      if (slot.used < victim->used) {
+        victim = &slot;
+      }
+    }
+    found = false;
+    victim->seed = seed;
+    victim->incr = incr;
+    victim->used = ++ clock;
+    victim->lua = false;
+    MakeHashProgram(seed, incr, victim->program);
+    return * victim;
+  }
+
+  static void Count (bool hit)
+  {
+    (hit ? g_dows_program_hits : g_dows_program_misses).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  lua_State * L = nullptr;
+  Slot slots[DOWS_PROGRAM_CACHE_SIZE];
+  uint64_t clock = 0;
+};
+
+// Shuffle h by running the generated program through Lua (the reference engine)
+static void ShuffleHash256Lua (uint64_t seed, uint64_t incr, uint8_t * h, bool cache, bool debug)
+{
+  DowsContext & context = DowsContext::Get();
+  context.LoadLuaProgram(seed, incr, cache);
+  lua_State * L = context.Lua();
+  ShuffleHash256(L, h);
+  lua_settop(L, 0);
 
-  MakeHashCode(seed, incr, code);
-  luaL_loadstring(L, code);
-  if (lua_pcall (L, 0, 0, 0)) {
 #ifdef  LOG_HASH
-    LogPrintf ("LUA error: %s\n", lua_tostring(L, -1));
+  if (debug) {
+        uint256 check;
+        MakeHashFunctions(seed, incr, context.code);
+        CHash256().Write ((const unsigned char *) DOWS_CODE_GLOBALS, strlen (DOWS_CODE_GLOBALS))
+                  .Write ((unsigned char *) context.code, strlen (context.code)).Finalize(check.begin());
+        LogPrint(BCLog::HASH, "Code hash = %s\n", check.ToString());
+  }
 #endif
-    lua_pop(L, 1);
+}
+
+// Shuffle h by running the decoded program directly on uint32_t
+static void ShuffleHash256Native (uint64_t seed, uint64_t incr, uint8_t * h, bool cache)
+{
+  ShuffleHash256(DowsContext::Get().NativeProgram(seed, incr, cache), h);
+}
+
+void GetDowsProgramCacheStats (uint64_t & hits, uint64_t & misses)
+{
+  hits = g_dows_program_hits.load(std::memory_order_relaxed);
+  misses = g_dows_program_misses.load(std::memory_order_relaxed);
+}
+
+// Ask for the cache lines of the 32-byte window at offset n, which may straddle two
+static inline void PrefetchHashBase (const uint8_t * base, uint32_t n)
+{
+#if defined(__GNUC__)
+  if (n <= HASH_BASE_SIZE_IN_BYTES - 32) {
+    __builtin_prefetch (base + n);
+    __builtin_prefetch (base + n + 31);
   }
+#endif
+}
 
-  ShuffleHash256(L, (uint8_t *) h);
-  lua_close (L);
+// Feed the hash base reads of several hashes to their hashers, interleaved so
+// that the prefetches of all of them are in flight together
+static void DowsSampleHashBaseLanes (const uint64_t * seed, const uint64_t * incr, CHash256 * hasher, int lanes)
+{
+  // Every read is a cache and TLB miss, but the offsets only depend on seed and
+  // incr. Draw them all first so the reads can be in flight while SHA256 works
+  // through the ones already loaded.
+  uint32_t offsets[DOWS_BATCH_LANES][HASH_BASE_USE_COUNT];
+  for (int l = 0; l < lanes; ++ l) {
+    CPCG32 pcg32 (seed[l], incr[l]);
+    for (int i = 0; i < HASH_BASE_USE_COUNT; ++ i) {
+      offsets[l][i] = pcg32.pcg32() % HASH_BASE_SIZE_IN_BYTES;
+    }
+  }
 
-  CHash256().Write (result.begin(), 32).Write (h, 32).Finalize(result.begin());
-  memcpy (h, result.begin(), 32);
-  for (i = 0; i < 32; i += 4) {
-    seed += GetUint64(h, i);
-    incr += GetUint64(h, 31 - i);
-    CPCG32 pcg32 (seed, incr);
-    seed += (uint64_t) pcg32.pcg32();
+  const uint8_t * base = (const uint8_t *) g_hashBase;
+  const int distance = std::max(1, HASH_BASE_PREFETCH_DISTANCE / lanes);
+  for (int i = 0; i < distance; ++ i) {
+    for (int l = 0; l < lanes; ++ l) {
+      PrefetchHashBase (base, offsets[l][i]);
+    }
   }
+  for (int i = 0; i < HASH_BASE_USE_COUNT; ++ i) {
+    for (int l = 0; l < lanes; ++ l) {
+      if (i + distance < HASH_BASE_USE_COUNT) {
+        PrefetchHashBase (base, offsets[l][i + distance]);
+      }
+      uint32_t n = offsets[l][i];
+      if (n <= HASH_BASE_SIZE_IN_BYTES - 32) {
+        hasher[l].Write (base + n, 32);
+        continue;
+      }
 
-  CHash256 & h256 = CHash256().Write (result.begin(), 32);
-  CPCG32 pcg32 (seed, incr);
-  for (i = 0; i < HASH_BASE_USE_COUNT; ++ i) {
-    uint32_t n = pcg32.pcg32() % HASH_BASE_SIZE_IN_BYTES;
-    if (n <= HASH_BASE_SIZE_IN_BYTES - 32) {
-      h256.Write (((uint8_t *) g_hashBase) + n, 32);
-      continue;
+      uint8_t b[32];
+      for (uint32_t j = 0; j < 32; ++ j) {
+        b[j] = base[(n + j) % HASH_BASE_SIZE_IN_BYTES];
+      }
+      hasher[l].Write (b, 32);
     }
+  }
+}
+
+void DowsSampleHashBase (uint64_t seed, uint64_t incr, CHash256 & hasher)
+{
+  DowsSampleHashBaseLanes (&seed, &incr, &hasher, 1);
+}
+
+// Everything DowsHash() does to the plain hash before the hash base reads, for
+// up to DOWS_BATCH_SIZE hashes at once: result becomes what the final hash
+// starts from, seed and incr drive the reads. The native engine runs the
+// shuffles interleaved. cache says whether to go through the thread's program
+// cache.
+static void DowsHashPrepareBatch (uint256 * result, uint64_t * seed, uint64_t * incr, int count, bool cache, bool debug)
+{
+  uint8_t h[DOWS_BATCH_SIZE][32];
 
-    uint8_t b[32];
-    for (uint32_t j = 0; j < 32; ++ j) {
-      b[j] = ((uint8_t *) g_hashBase)[(n + j) % HASH_BASE_SIZE_IN_BYTES];
+  for (int l = 0; l < count; ++ l) {
+    memcpy (h[l], result[l].begin(), 32);
+    seed[l] = 0;
+    incr[l] = 0;
+    DowsMixSeed (h[l], seed[l], incr[l]);
+  }
+
+  if (g_dows_engine == DowsEngine::NATIVE && count > 1) {
+    DowsProgram programs[DOWS_BATCH_SIZE];
+    uint8_t * hashes[DOWS_BATCH_SIZE];
+    for (int l = 0; l < count; ++ l) {
+      MakeHashProgram (seed[l], incr[l], programs[l]);
+      hashes[l] = h[l];
     }
-    h256.Write (b, 32);
+    ShuffleHash256Lanes (programs, hashes, count);
+  }
+  else for (int l = 0; l < count; ++ l) {
+    switch (g_dows_engine) {
+      case DowsEngine::LUA:
+        ShuffleHash256Lua (seed[l], incr[l], h[l], cache, debug);
+        break;
+      case DowsEngine::NATIVE:
+        ShuffleHash256Native (seed[l], incr[l], h[l], cache);
+        break;
+      case DowsEngine::CHECK: {
+        uint8_t n[32];
+        memcpy (n, h[l], 32);
+        ShuffleHash256Lua (seed[l], incr[l], h[l], cache, debug);
+        ShuffleHash256Native (seed[l], incr[l], n, cache);
+        if (memcmp (h[l], n, 32) != 0) {
+          LogPrintf("ERROR: %s: native DOWS engine disagrees with Lua for %s\n", __func__, result[l].ToString());
+        }
+        break;
+      }
+    }
+  }
+
+  for (int l = 0; l < count; ++ l) {
+    CHash256().Write (result[l].begin(), 32).Write (h[l], 32).Finalize(result[l].begin());
+    memcpy (h[l], result[l].begin(), 32);
+    DowsMixSeed (h[l], seed[l], incr[l]);
   }
+}
+
+static void DowsHashPrepare (uint256 & result, uint64_t & seed, uint64_t & incr, bool debug)
+{
+  DowsHashPrepareBatch (&result, &seed, &incr, 1, true, debug);
+}
+
+uint256 DowsHash(uint256 result, bool debug, bool test)
+{
+#ifdef  LOG_HASH
+  if (debug) {
+        LogPrint(BCLog::HASH, "Plain hash = %s\n", result.ToString());
+    }
+#endif
+
+  uint256 rawHash;
+
+  if (! test) {
+      rawHash = result;
+
+      // If the DOWS hash is in the cache, use it instead of recalculation
+
+      if (dowsHashCache.Get(rawHash, result)) {
+#ifdef  LOG_HASH
+          LogPrint(BCLog::HASH, "DOWS hash found in cache for %s\n", rawHash.ToString());
+#endif
+          return result;
+      }
+#ifdef  LOG_HASH
+      else {
+          LogPrint(BCLog::HASH, "DOWS hash not in cache for %s\n", result.ToString());
+      }
+#endif
+  }
+
+  // Binaries that never get this far, like sthcoin-tx, never pay for the hash base
+  if (! g_hash_base_ready.load(std::memory_order_acquire) && ! InitHashBase()) {
+    throw std::runtime_error("Unable to allocate memory for the hash base");
+  }
+
+  uint64_t seed, incr;
+  DowsHashPrepare (result, seed, incr, debug);
+
+  CHash256 h256;
+  h256.Write (result.begin(), 32);
+  DowsSampleHashBase (seed, incr, h256);
   h256.Finalize(result.begin());
 
   if (! test) {
@@ -817,26 +1492,85 @@ uint256 DowsHash(uint256 result, bool debug, bool test)
 
 #ifdef  LOG_HASH
   if (debug) {
-        uint256 check;
-        CHash256().Write ((unsigned char *) code, strlen (code)).Finalize(check.begin());
-        LogPrint(BCLog::HASH, "Code hash = %s\n", check.ToString());
         LogPrint(BCLog::HASH, "LUA hash = %s\n", result.ToString());
   }
 #endif
   return result;
 }
 
+bool DowsHashBatch (const unsigned char * header, uint32_t nonce_begin, uint32_t count, const uint256 & target, uint32_t & nonce, uint256 & hash, uint32_t & hashes)
+{
+  if (! g_hash_base_ready.load(std::memory_order_acquire) && ! InitHashBase()) {
+    throw std::runtime_error("Unable to allocate memory for the hash base");
+  }
+
+  // The first SHA256 block of the header does not depend on the nonce
+  CSHA256 midstate;
+  midstate.Write (header, 64);
+  unsigned char tail[DOWS_HEADER_SIZE - 64];
+  memcpy (tail, header + 64, sizeof(tail));
+
+  const arith_uint256 bnTarget = UintToArith256(target);
+  hashes = 0;
+  while (hashes < count) {
+    const int batch = (int) std::min<uint32_t>(DOWS_BATCH_SIZE, count - hashes);
+    uint256 result[DOWS_BATCH_SIZE];
+    uint64_t seed[DOWS_BATCH_SIZE], incr[DOWS_BATCH_SIZE];
+    for (int b = 0; b < batch; ++ b) {
+      unsigned char first[CSHA256::OUTPUT_SIZE];
+      WriteLE32 (tail + DOWS_HEADER_NONCE_POS - 64, nonce_begin + hashes + b);
+      CSHA256 (midstate).Write (tail, sizeof(tail)).Finalize (first);
+      CSHA256 ().Write (first, sizeof(first)).Finalize (result[b].begin());
+    }
+    // Every nonce has its own program, so mining would only churn the cache
+    DowsHashPrepareBatch (result, seed, incr, batch, false, false);
+
+    for (int b = 0; b < batch; b += DOWS_BATCH_LANES) {
+      const int lanes = std::min(DOWS_BATCH_LANES, batch - b);
+      CHash256 hasher[DOWS_BATCH_LANES];
+      for (int l = 0; l < lanes; ++ l) {
+        hasher[l].Write (result[b + l].begin(), 32);
+      }
+      DowsSampleHashBaseLanes (seed + b, incr + b, hasher, lanes);
+      for (int l = 0; l < lanes; ++ l) {
+        hasher[l].Finalize (result[b + l].begin());
+        ++ hashes;
+        if (UintToArith256(result[b + l]) <= bnTarget) {
+          nonce = nonce_begin + hashes - 1;
+          hash = result[b + l];
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+
+void InitDowsHashCache (size_t bytes)
+{
+    size_t capacity = dowsHashCache.setup_bytes(bytes);
+    LogPrintf("Using %zu MiB out of %zu requested for the DOWS hash cache, able to store %zu elements\n",
+              dowsHashCache.DynamicMemoryUsage() >> 20, bytes >> 20, capacity);
+}
 
 void AddToDowsHashCache (uint256 & rawHash, uint256 & dowsHash)
 {
-    hash256_array rawHashArray, dowsHashArray;
+    dowsHashCache.Put(rawHash, dowsHash);
+    if (g_is_dows_hash_cache_loaded) {
+        std::lock_guard<std::mutex> lock(g_dows_cache_pending_mutex);
+        g_dows_cache_pending.emplace_back(rawHash, dowsHash);
+    }
+}
 
-    memcpy (rawHashArray.data (), rawHash.begin (), 32);
-    memcpy (dowsHashArray.data (), dowsHash.begin (), 32);
+bool SetDowsHashCacheLevel (const uint256 & rawHash, CDowsHashCache::Level level)
+{
+    return dowsHashCache.SetLevel(rawHash, level);
+}
 
-    GetDowsHashCacheLock();
-    dowsHashCache.emplace (rawHashArray, dowsHashArray);
-    dowsHashLock.store(false);
+CDowsHashCache::Stats GetDowsHashCacheStats ()
+{
+    return dowsHashCache.GetStats();
 }
 
 void CalculateDowsHashCacheChecksum (hash256_array k, hash256_array v, dows_hash_cache_checksum_t & checksum)
@@ -846,74 +1580,130 @@ void CalculateDowsHashCacheChecksum (hash256_array k, hash256_array v, dows_hash
     memcpy (checksum.data(), hash.begin (), DOWS_HASH_CACHE_CHECKSUM_SIZE);
 }
 
-/** Load the script pairs from disk. */
-bool LoadDowsHashCache (void)
+static void WriteDowsHashCacheRecord (CAutoFile & file, const uint256 & raw, const uint256 & dows)
 {
-    FILE* filestr = fsbridge::fopen(GetDataDir() / "hash.dat", "rb");
-    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-    if (file.IsNull()) {
+    hash256_array k, v;
+    dows_hash_cache_checksum_t cs;
+    memcpy (k.data (), raw.begin (), 32);
+    memcpy (v.data (), dows.begin (), 32);
+    CalculateDowsHashCacheChecksum(k, v, cs);
+    file.write (k.data (), k.size ());
+    file.write (v.data (), v.size ());
+    file.write (cs.data (), cs.size ());
+}
+
+/** Load the hash pairs from disk. hash.dat is a version followed by records;
+ *  version 1 files also store the record count after the version. The file is
+ *  read in large blocks whose checksums are verified on all cores, and each
+ *  block goes into the cache in one batch. */
+bool LoadDowsHashCache (const std::function<bool()> & interrupt)
+{
+    int64_t start = GetTimeMicros();
+    fs::path path = GetDataDir() / "hash.dat";
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) {
         LogPrintf("Failed to open hash file from disk. Continuing anyway.\n");
         return false;
     }
 
-    uint64_t count = 0;
-    uint64_t num, n;
-
-    try {
-        uint64_t version;
-        file >> version;
-        if (version != DOWS_HASH_CACHE_VERSION) {
+    unsigned char header[16];
+    uint64_t version, n;
+    if (fread(header, 1, 8, file) != 8) {
+        fclose(file);
+        LogPrintf("Failed to deserialize hash data on disk: truncated header. Continuing anyway.\n");
+        return false;
+    }
+    version = ReadLE64(header);
+    if (version == 1) {
+        if (fread(header + 8, 1, 8, file) != 8) {
+            fclose(file);
             return false;
         }
-        file >> num;
-        n = num;
-        {
-            while (num) {
-                hash256_array k, v;
-                dows_hash_cache_checksum_t cs1, cs2;
-                file.read (k.data (), k.size());
-                file.read (v.data (), v.size());
-                file.read (cs1.data (), cs1.size ());
-                CalculateDowsHashCacheChecksum(k, v, cs2);
-                if (memcmp(cs1.data (), cs2.data (), DOWS_HASH_CACHE_CHECKSUM_SIZE) == 0) {
-                    GetDowsHashCacheLock();
-                    dowsHashCache.emplace(k, v);
-                    dowsHashLock.store(false);
-                    ++count;
-                }
-                -- num;
-                if (ShutdownRequested())
-                    return false;
+        n = ReadLE64(header + 8);
+    } else if (version == DOWS_HASH_CACHE_VERSION) {
+        // Records are only ever appended; a torn last one is dropped
+        n = (fs::file_size(path) - 8) / DOWS_HASH_CACHE_RECORD_SIZE;
+    } else {
+        fclose(file);
+        return false;
+    }
+
+    int threads = std::max(1, std::min(GetNumCores(), DOWS_HASH_CACHE_LOAD_MAX_THREADS));
+    std::vector<unsigned char> buffer(DOWS_HASH_CACHE_LOAD_CHUNK * DOWS_HASH_CACHE_RECORD_SIZE);
+    std::vector<char> valid(DOWS_HASH_CACHE_LOAD_CHUNK);
+    std::vector<std::pair<uint256, uint256>> entries;
+    uint64_t count = 0, read = 0;
+
+    auto verify = [&buffer, &valid](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const unsigned char * record = buffer.data() + i * DOWS_HASH_CACHE_RECORD_SIZE;
+            unsigned char checksum[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(record, 64).Finalize(checksum);
+            valid[i] = memcmp(checksum, record + 64, DOWS_HASH_CACHE_CHECKSUM_SIZE) == 0;
+        }
+    };
+
+    while (read < n) {
+        size_t want = (size_t) std::min<uint64_t>(DOWS_HASH_CACHE_LOAD_CHUNK, n - read);
+        size_t got = fread(buffer.data(), DOWS_HASH_CACHE_RECORD_SIZE, want, file);
+        if (got == 0) {
+            break;
+        }
+
+        std::vector<std::thread> workers;
+        size_t slice = got / threads + 1;
+        for (int t = 1; t < threads && slice * t < got; ++t) {
+            workers.emplace_back(verify, slice * t, std::min(got, slice * (t + 1)));
+        }
+        verify(0, std::min(got, slice));
+        for (std::thread & worker : workers) {
+            worker.join();
+        }
+
+        entries.clear();
+        for (size_t i = 0; i < got; ++i) {
+            if (valid[i]) {
+                const unsigned char * record = buffer.data() + i * DOWS_HASH_CACHE_RECORD_SIZE;
+                entries.emplace_back();
+                memcpy(entries.back().first.begin(), record, 32);
+                memcpy(entries.back().second.begin(), record + 32, 32);
             }
         }
-        file.fclose ();
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize hash data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
+        dowsHashCache.PutBatch(entries);
+        count += entries.size();
+        read += got;
+
+        if (got < want) {
+            break;
+        }
+        if (interrupt && interrupt()) {
+            fclose(file);
+            return false;
+        }
     }
+    fclose(file);
 
-    LogPrintf("Imported hashes from disk: %i succeeded, %i missed\n", count, n - count);
+    {
+        LOCK (cs_dows_cache_save);
+        g_dows_cache_file_records = read;
+        // Rewrite old formats and files with damaged records on the first flush
+        g_dows_cache_file_compact = version != DOWS_HASH_CACHE_VERSION || count != n;
+    }
+    double seconds = std::max<int64_t>(GetTimeMicros() - start, 1) * 0.000001;
+    LogPrintf("Imported hashes from disk: %i succeeded, %i missed in %gs (%.1f MB/s)\n",
+              count, n - count, seconds, read * DOWS_HASH_CACHE_RECORD_SIZE / seconds / 1000000);
     return true;
 }
 
 #define MICRO 0.000001
 
-bool DumpDowsHashCache(void)
+/** Rewrite hash.dat from the cache contents. */
+static bool CompactDowsHashCache (void) EXCLUSIVE_LOCKS_REQUIRED(cs_dows_cache_save)
 {
     int64_t start = GetTimeMicros();
-    dows_hash_cache_t dowsHashCacheCopy;
-
-    {
-        LOCK(cs_main);
-        for (const auto &i :  dowsHashCache) {
-            dowsHashCacheCopy[i.first] = i.second;
-        }
-    }
-
-    int64_t mid = GetTimeMicros();
+    uint64_t records = 0;
 
     try {
-        LOCK (cs_dows_cache_save);
         FILE* filestr = fsbridge::fopen(GetDataDir() / "hash.dat.new", "wb");
         if (!filestr) {
             return false;
@@ -924,29 +1714,81 @@ bool DumpDowsHashCache(void)
         uint64_t version = DOWS_HASH_CACHE_VERSION;
         file << version;
 
-        file << (uint64_t) dowsHashCacheCopy.size();
-        for (const auto& i : dowsHashCacheCopy) {
-            const auto & k = i.first;
-            const auto & v = i.second;
-            file.write (k.data (), k.size ());
-            file.write (v.data (), v.size ());
-            dows_hash_cache_checksum_t cs;
-            CalculateDowsHashCacheChecksum(k, v, cs);
-            file.write (cs.data (), cs.size ());
-        }
+        dowsHashCache.ForEach([&file, &records](const uint256 & raw, const uint256 & dows) {
+            WriteDowsHashCacheRecord(file, raw, dows);
+            ++records;
+        });
 
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
         RenameOver(GetDataDir() / "hash.dat.new", GetDataDir() / "hash.dat");
-        int64_t last = GetTimeMicros();
-        LogPrintf("Dumped %d hashes: %gs to copy, %gs to dump\n", dowsHashCacheCopy.size (), (mid-start)*MICRO, (last-mid)*MICRO);
     } catch (const std::exception& e) {
         LogPrintf("Failed to dump hashes: %s. Continuing anyway.\n", e.what());
         return false;
     }
+
+    g_dows_cache_file_records = records;
+    g_dows_cache_file_compact = false;
+    LogPrintf("Dumped %d hashes: %gs\n", records, (GetTimeMicros() - start) * MICRO);
+    return true;
+}
+
+bool FlushDowsHashCache (void)
+{
+    std::vector<std::pair<uint256, uint256>> pending;
+    {
+        std::lock_guard<std::mutex> lock(g_dows_cache_pending_mutex);
+        pending.swap(g_dows_cache_pending);
+    }
+
+    LOCK (cs_dows_cache_save);
+
+    // Entries evicted from the cache stay in the log until it is compacted;
+    // compact once the log holds twice what the cache does
+    if (g_dows_cache_file_compact || g_dows_cache_file_records + pending.size() > 2 * dowsHashCache.GetStats().entries + DOWS_HASH_CACHE_COMPACT_SLACK) {
+        return CompactDowsHashCache();
+    }
+    if (pending.empty()) {
+        return true;
+    }
+
+    int64_t start = GetTimeMicros();
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "hash.dat", "ab");
+        if (!filestr) {
+            g_dows_cache_file_compact = true;
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        for (const auto& i : pending) {
+            WriteDowsHashCacheRecord(file, i.first, i.second);
+        }
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+    } catch (const std::exception& e) {
+        // The tail of the log may be torn; start over from the cache next time
+        g_dows_cache_file_compact = true;
+        LogPrintf("Failed to append hashes: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    g_dows_cache_file_records += pending.size();
+    LogPrint(BCLog::HASH, "Appended %d hashes: %gs\n", pending.size(), (GetTimeMicros() - start) * MICRO);
     return true;
+}
 
+void ThreadDowsHashCacheWriter (void)
+{
+    while (g_dows_cache_writer_interrupt.sleep_for(std::chrono::seconds(DOWS_HASH_CACHE_FLUSH_INTERVAL))) {
+        FlushDowsHashCache();
+    }
 }
 
-// } + 
\ No newline at end of file
+void InterruptDowsHashCacheWriter (void)
+{
+    g_dows_cache_writer_interrupt();
+}
@@ -18,6 +18,9 @@
 
 // { + 
 #include <chrono>
+#include <functional>
+
+#include <dowscache.h>
 
 extern "C"
 {
@@ -29,18 +32,84 @@ extern "C"
 #define HASH_BASE_SIZE  (456789889u)
 #define HASH_BASE_SIZE_IN_BYTES (HASH_BASE_SIZE * 4)
 #define HASH_BASE_INIT_INTERVAL 60000
+#define MAX_STMT_NUM       12
+#define FUNC_COUNT     16  // Number of functions in the hashing code
+#define DOWS_PRIME_COUNT   97
+#define DOWS_OP_CALL   9   // statement that calls another function of the program
+#define DOWS_HEADER_SIZE       84  // serialized block header
+#define DOWS_HEADER_NONCE_POS  76  // offset of nNonce in the serialized block header
+#define DOWS_BATCH_LANES        4  // nonces DowsHashBatch() carries through each stage together
+#define DOWS_BATCH_SIZE        16  // nonces DowsHashBatch() shuffles together, DOWS_BATCH_LANES at a time
+#define DOWS_PROGRAM_CACHE_SIZE 32  // compiled programs each hashing thread keeps
+
+/** Engine evaluating the generated DOWS program. */
+enum class DowsEngine {
+    NATIVE, //!< decoded into an op table and run directly on uint32_t
+    LUA,    //!< interpreted by Lua, the reference implementation
+    CHECK,  //!< run both and log any disagreement (differential test mode)
+};
 
-extern std::atomic_bool g_is_dows_hash_cache_loaded;
-extern std::chrono::time_point<std::chrono::system_clock> last_dows_cache_save_time;
+static const char* const DEFAULT_DOWS_ENGINE = "native";
+static const char* const DEFAULT_HASH_BASE_FILE = "hashbase.dat";
+static const bool DEFAULT_HASH_BASE_POPULATE = false;
+static const bool DEFAULT_HASH_BASE_HUGEPAGES = true;
+/** Default for -dowscachesize, the DOWS hash cache budget in MiB */
+static const int64_t DEFAULT_DOWS_CACHE_SIZE = 80;
+/** Maximum for -dowscachesize in MiB */
+static const int64_t MAX_DOWS_CACHE_SIZE = 16384;
+
+class CHash256;
+
+/** Decoded form of the program generated by MakeHashCode(). */
+struct DowsProgram {
+    uint8_t stmtCount[FUNC_COUNT];
+    uint8_t stmts[FUNC_COUNT][MAX_STMT_NUM]; //!< primitive index 0-8 (A-I) or DOWS_OP_CALL
+};
 
-void InitHashBase ();
+extern std::atomic_bool g_is_dows_hash_cache_loaded;
+extern DowsEngine g_dows_engine;
+
+/** Set up the hash base: map it from file if given and valid, otherwise generate
+ *  it in memory on all cores and, if file is given, write it there for the next
+ *  start. progress, if set, is called with 0-100 from the calling thread.
+ *  DowsHash() calls it with the defaults on first use if nothing did before. */
+bool InitHashBase (const std::string & file = "", bool populate = DEFAULT_HASH_BASE_POPULATE, bool hugepages = DEFAULT_HASH_BASE_HUGEPAGES, const std::function<void(int)> & progress = nullptr);
+bool ParseDowsEngine (const std::string & name, DowsEngine & engine);
 void MakeHashCode (uint64_t seed, uint64_t incr, char * code);
+void MakeHashProgram (uint64_t seed, uint64_t incr, DowsProgram & program);
 void ShuffleHash256 (lua_State * L, uint8_t * hash);
+void ShuffleHash256 (const DowsProgram & program, uint8_t * hash);
+/** ShuffleHash256 of count programs and hashes, DOWS_BATCH_LANES at a time
+ *  interleaved so that their hash base reads are in flight together. */
+void ShuffleHash256Lanes (const DowsProgram * programs, uint8_t * const * hashes, size_t count);
 uint256 DowsHash(uint256 result, bool debug, bool test = false);
-inline void GetDowsHashCacheLock ();
+/** Stages of DowsHash(), exposed for benchmarks and tests. DowsMixSeed folds
+ *  32 bytes into the PCG seed and increment, NewDowsLuaState returns a Lua state
+ *  with the primitives registered, and DowsSampleHashBase feeds the
+ *  HASH_BASE_USE_COUNT hash base reads for seed and incr to hasher. */
+void DowsMixSeed (const uint8_t * h, uint64_t & seed, uint64_t & incr);
+lua_State * NewDowsLuaState (void);
+void DowsSampleHashBase (uint64_t seed, uint64_t incr, CHash256 & hasher);
+/** Hash up to count variants of the DOWS_HEADER_SIZE serialized block header
+ *  that differ only in the nonce, from nonce_begin on, as DowsHash() does with
+ *  test = true. Stops at the first variant whose hash is at most target and
+ *  returns true with its nonce and hash. hashes is set to the number hashed. */
+bool DowsHashBatch (const unsigned char * header, uint32_t nonce_begin, uint32_t count, const uint256 & target, uint32_t & nonce, uint256 & hash, uint32_t & hashes);
+/** Size the DOWS hash cache to fit in bytes. Until this is called, nothing is cached. */
+void InitDowsHashCache (size_t bytes = DEFAULT_DOWS_CACHE_SIZE << 20);
 void AddToDowsHashCache (uint256 & rawHash, uint256 & dowsHash);
-bool LoadDowsHashCache (void);
-bool DumpDowsHashCache(void);
+bool LoadDowsHashCache (const std::function<bool()> & interrupt = nullptr);
+/** Append the hashes computed since the last call to hash.dat, or rewrite it
+ *  from the cache when it has grown too far past it. */
+bool FlushDowsHashCache (void);
+/** Flush the DOWS hash cache every minute until interrupted */
+void ThreadDowsHashCacheWriter (void);
+void InterruptDowsHashCacheWriter (void);
+/** Mark how much the cached DOWS hash of a header is worth keeping; see CDowsHashCache::Level */
+bool SetDowsHashCacheLevel (const uint256 & rawHash, CDowsHashCache::Level level);
+CDowsHashCache::Stats GetDowsHashCacheStats ();
+/** Lookups of the per-thread caches of compiled DOWS programs, summed over all threads */
+void GetDowsProgramCacheStats (uint64_t & hits, uint64_t & misses);
 
 // https://en.wikipedia.org/wiki/Permuted_congruential_generator
 
@@ -67,6 +136,24 @@ public:
     return rotr32((uint32_t)(x >> 27), count);	// 27 = 32 - 5
   }
 
+  /** Skip delta outputs in O(log delta), as if pcg32() had been called delta times */
+  void advance (uint64_t delta)
+  {
+    uint64_t cur_mult = multiplier, cur_plus = increment;
+    uint64_t acc_mult = 1, acc_plus = 0;
+
+    while (delta > 0) {
+      if (delta & 1) {
+        acc_mult *= cur_mult;
+        acc_plus = acc_plus * cur_mult + cur_plus;
+      }
+      cur_plus = (cur_mult + 1) * cur_plus;
+      cur_mult *= cur_mult;
+      delta >>= 1;
+    }
+    state = acc_mult * state + acc_plus;
+  }
+
   int32_t randint (int32_t a, int32_t b)
   {
     int32_t min, max;
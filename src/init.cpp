@@ -21,6 +21,7 @@
 #include <httprpc.h>
 #include <index/txindex.h>
 #include <key.h>
+#include <key_io.h> // + 
 #include <validation.h>
 #include <miner.h>
 #include <netbase.h>
@@ -150,16 +151,30 @@ public:
         try {
             return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
-            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
-            LogPrintf("Error reading from database: %s\n", e.what());
-            // Starting the shutdown sequence and returning false to the caller would be
-            // interpreted as 'entry not found' (as opposed to unable to read data), and
-            // could lead to invalid interpretation. Just exit immediately, as we can't
-            // continue anyway, and all writes should be atomic.
-            abort();
+            ReadError(e); // & 
         }
     }
+    // { + 
+    size_t GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override {
+        try {
+            return base->GetCoins(outpoints, coins);
+        } catch(const std::runtime_error& e) {
+            ReadError(e);
+        }
+    }
+    // } + 
     // Writes do not need similar protection, as failure to write is handled by the caller.
+
+private: // + 
+    [[noreturn]] static void ReadError(const std::runtime_error& e) { // + 
+        uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+        LogPrintf("Error reading from database: %s\n", e.what());
+        // Starting the shutdown sequence and returning false to the caller would be
+        // interpreted as 'entry not found' (as opposed to unable to read data), and
+        // could lead to invalid interpretation. Just exit immediately, as we can't
+        // continue anyway, and all writes should be atomic.
+        abort();
+    } // + 
 };
 
 static std::unique_ptr<CCoinsViewErrorCatcher> pcoinscatcher;
@@ -181,6 +196,7 @@ void Interrupt()
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    InterruptDowsHashCacheWriter(); // + 
 }
 
 void Shutdown()
@@ -197,6 +213,7 @@ void Shutdown()
     /// module was initialized.
     RenameThread("sthcoin-shutoff");
     mempool.AddTransactionsUpdated(1);
+    GenerateSthcoins(false, 0, CScript(), Params()); // + 
 
     StopHTTPRPC();
     StopREST();
@@ -230,7 +247,7 @@ void Shutdown()
 
     // { + 
     if (g_is_dows_hash_cache_loaded) {
-        DumpDowsHashCache();
+        FlushDowsHashCache();
     }
     // } + 
 
@@ -373,6 +390,10 @@ void SetupServerArgs()
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dowscachesize=<n>", strprintf("Limit the cache of computed DOWS hashes to <n> MiB (default: %u)", DEFAULT_DOWS_CACHE_SIZE), false, OptionsCategory::OPTIONS); // + 
+    gArgs.AddArg("-hashbasefile=<file>", strprintf("Map the DOWS hash base from <file>, writing it there first if it is missing or invalid. Relative paths will be prefixed by the datadir location (1 to use %s, default: generate in memory)", DEFAULT_HASH_BASE_FILE), false, OptionsCategory::OPTIONS); // + 
+    gArgs.AddArg("-hashbasehugepages", strprintf("Ask for transparent huge pages to back the hash base (default: %u)", DEFAULT_HASH_BASE_HUGEPAGES), true, OptionsCategory::OPTIONS); // + 
+    gArgs.AddArg("-hashbasepopulate", strprintf("Fault the whole -hashbasefile mapping in at startup (default: %u)", DEFAULT_HASH_BASE_POPULATE), true, OptionsCategory::OPTIONS); // + 
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-loadblock=<file>", "Imports blocks from external blk000??.dat file on startup", false, OptionsCategory::OPTIONS);
@@ -457,12 +478,14 @@ void SetupServerArgs()
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-checkblockindexpow=<n>", strprintf("How many blocks below the best header to recompute the block index hashes of at startup (default: %d, -1 = all)", DEFAULT_CHECKBLOCKINDEXPOW), true, OptionsCategory::DEBUG_TEST); // + 
     gArgs.AddArg("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is (0-4, default: %u)", DEFAULT_CHECKLEVEL), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages", true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-dowsengine=<engine>", strprintf("Evaluate the DOWS hash program with the given engine: native, lua, or check to run both and log any disagreement (default: %s)", DEFAULT_DOWS_ENGINE), true, OptionsCategory::DEBUG_TEST); // + 
     gArgs.AddArg("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopatheight", strprintf("Stop running after reaching the given height in the main chain (default: %u)", DEFAULT_STOPATHEIGHT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT), true, OptionsCategory::DEBUG_TEST);
@@ -506,6 +529,11 @@ void SetupServerArgs()
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", true, OptionsCategory::BLOCK_CREATION);
+    // { + 
+    gArgs.AddArg("-gen", strprintf("Run the built-in miner, paying to -genaddress (default: %u)", DEFAULT_GENERATE), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genaddress=<address>", "Address the built-in miner pays its blocks to", false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genproclimit=<n>", strprintf("Number of built-in miner threads (-1 = all cores, default: %d)", DEFAULT_GENERATE_THREADS), false, OptionsCategory::BLOCK_CREATION);
+    // } + 
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", false, OptionsCategory::RPC);
@@ -1014,6 +1042,14 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    nCheckBlockIndexPow = std::max(-1, (int)gArgs.GetArg("-checkblockindexpow", DEFAULT_CHECKBLOCKINDEXPOW)); // + 
+
+    // { + 
+    const std::string dows_engine = gArgs.GetArg("-dowsengine", DEFAULT_DOWS_ENGINE);
+    if (!ParseDowsEngine(dows_engine, g_dows_engine)) {
+        return InitError(strprintf(_("Unknown DOWS engine specified in -dowsengine: '%s'"), dows_engine));
+    }
+    // } + 
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1267,6 +1303,30 @@ bool AppInitMain()
     InitSignatureCache();
     InitScriptExecutionCache();
 
+    // { + 
+    InitDowsHashCache(std::min(std::max((int64_t)0, gArgs.GetArg("-dowscachesize", DEFAULT_DOWS_CACHE_SIZE)), MAX_DOWS_CACHE_SIZE) << 20);
+    uiInterface.InitMessage(_("Loading hash base..."));
+    std::string hash_base_file = gArgs.GetArg("-hashbasefile", "");
+    if (hash_base_file == "1") {
+        hash_base_file = DEFAULT_HASH_BASE_FILE;
+    } else if (hash_base_file == "0") {
+        hash_base_file.clear();
+    }
+    if (!hash_base_file.empty()) {
+        // The hash base does not depend on the network, so share it across them
+        hash_base_file = AbsPathForConfigVal(hash_base_file, false).string();
+    }
+    auto hash_base_progress = [](int percent) {
+        uiInterface.ShowProgress(_("Generating hash base..."), percent, false);
+    };
+    if (!InitHashBase(hash_base_file, gArgs.GetBoolArg("-hashbasepopulate", DEFAULT_HASH_BASE_POPULATE), gArgs.GetBoolArg("-hashbasehugepages", DEFAULT_HASH_BASE_HUGEPAGES), hash_base_progress)) {
+        return InitError(_("Unable to allocate memory for the hash base."));
+    }
+    if (chainparams.GenesisBlock().GetTestHash() != chainparams.GetConsensus().hashGenesisBlock) {
+        return InitError(_("The hash base does not reproduce the genesis block hash. Remove the -hashbasefile file and restart."));
+    }
+    // } + 
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
@@ -1446,10 +1506,11 @@ bool AppInitMain()
 
     // { + 
     if (!g_is_dows_hash_cache_loaded && !ShutdownRequested()) {
-        LOCK(cs_main);
-        LoadDowsHashCache();
+        LoadDowsHashCache(ShutdownRequested); // 
         g_is_dows_hash_cache_loaded = !ShutdownRequested();
-        last_dows_cache_save_time = std::chrono::system_clock::now();
+        if (g_is_dows_hash_cache_loaded) {
+            threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "dowscache", &ThreadDowsHashCacheWriter));
+        }
     }
     // } + 
 
@@ -1772,6 +1833,16 @@ bool AppInitMain()
         return false;
     }
 
+    // { + 
+    if (gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)) {
+        CTxDestination destination = DecodeDestination(gArgs.GetArg("-genaddress", ""));
+        if (!IsValidDestination(destination)) {
+            return InitError(_("-gen requires a valid -genaddress"));
+        }
+        GenerateSthcoins(true, gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS), GetScriptForDestination(destination), chainparams);
+    }
+    // } + 
+
     // ********************************************************* Step 13: finished
 
     SetRPCWarmupFinished();
@@ -26,9 +26,13 @@
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <atomic> // + 
+#include <mutex> // + 
 #include <queue>
 #include <utility>
 
+#include <boost/thread.hpp> // + 
+
 // Unconfirmed transactions in the memory pool often depend on other
 // transactions in the memory pool. When we select transactions from the
 // pool, we select by highest fee rate of a transaction combined with all
@@ -469,3 +473,163 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+// { + 
+/** Nonces a miner thread hashes between checks for a new tip, a stale template or a stop request */
+static const uint32_t MINER_CHECK_INTERVAL = 64;
+/** Seconds a template is kept once the mempool has changed under it */
+static const int64_t MINER_TEMPLATE_REFRESH = 60;
+/** Seconds between hash rate samples */
+static const int64_t MINER_HASHMETER_INTERVAL = 10;
+
+static std::mutex g_miner_mutex;
+static std::unique_ptr<boost::thread_group> g_miner_threads; // Guarded by g_miner_mutex
+static std::atomic<int> g_miner_thread_count(0);
+static std::atomic<uint64_t> g_miner_hashes(0);
+
+static std::mutex g_hashmeter_mutex;
+static int64_t g_hashmeter_start = 0;
+static uint64_t g_hashmeter_hashes = 0;
+static double g_hashmeter_rate = 0;
+
+static void ResetHashMeter()
+{
+    std::lock_guard<std::mutex> lock(g_hashmeter_mutex);
+    g_hashmeter_start = GetTimeMillis();
+    g_hashmeter_hashes = g_miner_hashes;
+    g_hashmeter_rate = 0;
+}
+
+// Count hashes done by a miner thread. Whoever finds the sample window over
+// recomputes the rate; the others never wait for it.
+static void UpdateHashMeter(uint64_t hashes)
+{
+    uint64_t total = g_miner_hashes.fetch_add(hashes) + hashes;
+    std::unique_lock<std::mutex> lock(g_hashmeter_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+    int64_t now = GetTimeMillis();
+    if (now - g_hashmeter_start < MINER_HASHMETER_INTERVAL * 1000) {
+        return;
+    }
+    g_hashmeter_rate = 1000.0 * (total - g_hashmeter_hashes) / (now - g_hashmeter_start);
+    g_hashmeter_start = now;
+    g_hashmeter_hashes = total;
+}
+
+static void SthcoinMiner(const CChainParams& chainparams, const CScript& coinbase_script, int thread_id, int thread_count)
+{
+    LogPrintf("SthcoinMiner thread %d started\n", thread_id);
+    RenameThread("sthcoin-miner");
+
+    // Threads working on the same template scan disjoint slices of the nonce
+    // space, so they never repeat each other's work
+    const uint64_t slice = ((UINT64_C(1) << 32) / thread_count) / MINER_CHECK_INTERVAL * MINER_CHECK_INTERVAL;
+    const uint32_t nonce_begin = (uint32_t)(slice * thread_id);
+    unsigned int nExtraNonce = 0;
+
+    try {
+        while (true) {
+            if (!chainparams.MineBlocksOnDemand()) {
+                // Don't mine on a chain we are still catching up with, or with nobody to relay the block to
+                while ((g_connman && g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) || IsInitialBlockDownload()) {
+                    MilliSleep(1000);
+                    boost::this_thread::interruption_point();
+                }
+            }
+
+            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(coinbase_script));
+            CBlock* pblock = &pblocktemplate->block;
+            const CBlockIndex* pindexPrev;
+            {
+                LOCK(cs_main);
+                pindexPrev = LookupBlockIndex(pblock->hashPrevBlock);
+                IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+            }
+
+            arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+            int64_t nStart = GetTime();
+            uint64_t nHashes = 0;
+            pblock->nNonce = nonce_begin;
+            while (true) {
+                uint32_t hashes;
+                bool found = DowsHashBatch(*pblock, pblock->nNonce, MINER_CHECK_INTERVAL, ArithToUint256(hashTarget), hashes);
+                nHashes += hashes;
+                UpdateHashMeter(hashes);
+                if (found) {
+                    uint256 hash = pblock->GetHash();
+                    LogPrintf("SthcoinMiner: proof-of-work found by thread %d\n  hash: %s\ntarget: %s\n", thread_id, hash.GetHex(), hashTarget.GetHex());
+                    std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
+                    if (!ProcessNewBlock(chainparams, shared_pblock, true, nullptr)) {
+                        LogPrintf("SthcoinMiner: block %s was not accepted\n", hash.GetHex());
+                    }
+                    break;
+                }
+
+                boost::this_thread::interruption_point();
+                if (nHashes >= slice) {
+                    break; // Slice exhausted, go on with the next extranonce
+                }
+                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > MINER_TEMPLATE_REFRESH) {
+                    break;
+                }
+                {
+                    LOCK(cs_main);
+                    if (chainActive.Tip() != pindexPrev) {
+                        break;
+                    }
+                }
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        LogPrintf("SthcoinMiner thread %d stopped\n", thread_id);
+        throw;
+    } catch (const std::runtime_error& e) {
+        LogPrintf("SthcoinMiner thread %d runtime error: %s\n", thread_id, e.what());
+    }
+}
+
+void GenerateSthcoins(bool fGenerate, int nThreads, const CScript& coinbase_script, const CChainParams& chainparams)
+{
+    std::lock_guard<std::mutex> lock(g_miner_mutex);
+
+    if (g_miner_threads) {
+        g_miner_threads->interrupt_all();
+        g_miner_threads->join_all();
+        g_miner_threads.reset();
+        g_miner_thread_count = 0;
+    }
+    ResetHashMeter();
+
+    if (nThreads < 0) {
+        nThreads = GetNumCores();
+    }
+    if (!fGenerate || nThreads == 0) {
+        return;
+    }
+
+    g_miner_threads.reset(new boost::thread_group());
+    for (int i = 0; i < nThreads; ++i) {
+        g_miner_threads->create_thread([&chainparams, coinbase_script, i, nThreads] {
+            SthcoinMiner(chainparams, coinbase_script, i, nThreads);
+        });
+    }
+    g_miner_thread_count = nThreads;
+}
+
+int GetMinerThreads()
+{
+    return g_miner_thread_count;
+}
+
+double GetMinerHashesPerSec()
+{
+    if (g_miner_thread_count == 0) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(g_hashmeter_mutex);
+    return g_hashmeter_rate;
+}
+// } + 
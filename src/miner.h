@@ -22,6 +22,12 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+// { + 
+/** Whether the built-in miner runs at startup (-gen) */
+static const bool DEFAULT_GENERATE = false;
+/** Number of built-in miner threads (-genproclimit), -1 for one per core */
+static const int DEFAULT_GENERATE_THREADS = 1;
+// } + 
 
 struct CBlockTemplate
 {
@@ -197,4 +203,17 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+// { + 
+/**
+ * Start (or restart) the built-in miner with nThreads workers paying to
+ * coinbase_script, or stop it when fGenerate is false or nThreads is 0.
+ * A negative nThreads starts one worker per core.
+ */
+void GenerateSthcoins(bool fGenerate, int nThreads, const CScript& coinbase_script, const CChainParams& chainparams);
+/** Number of running built-in miner threads */
+int GetMinerThreads();
+/** Hash rate of the built-in miner over its last measurement window, 0 when stopped */
+double GetMinerHashesPerSec();
+// } + 
+
 #endif // STHCOIN_MINER_H
@@ -29,6 +29,17 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    // { + 
+    /** Send payload bytes that are already serialized, taking them over rather than copying them */
+    CSerializedNetMsg MakeRaw(std::string sCommand, std::vector<unsigned char>&& data) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.data = std::move(data);
+        return msg;
+    }
+    // } + 
+
 private:
     const int nVersion;
 };
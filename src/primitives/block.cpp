@@ -6,19 +6,87 @@
 #include <primitives/block.h>
 
 #include <hash.h>
+#include <streams.h> // + 
 #include <tinyformat.h>
 #include <utilstrencodings.h>
 #include <crypto/common.h>
 
 
 // { + 
+struct CBlockHashMemo::Entry
+{
+    int32_t nVersion;
+    uint256 hashPrevBlock;
+    uint256 hashMerkleRoot;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nNonce;
+    uint32_t nChainId;
+    uint256 hash;
+    bool cached;
+};
+
+bool CBlockHashMemo::Get(const CBlockHeader& header, uint256& hash, bool& cached) const
+{
+    std::shared_ptr<const Entry> entry = std::atomic_load(&m_entry);
+    if (!entry ||
+        entry->nNonce != header.nNonce ||
+        entry->nTime != header.nTime ||
+        entry->hashMerkleRoot != header.hashMerkleRoot ||
+        entry->hashPrevBlock != header.hashPrevBlock ||
+        entry->nBits != header.nBits ||
+        entry->nVersion != header.nVersion ||
+        entry->nChainId != header.nChainId) {
+        return false;
+    }
+    hash = entry->hash;
+    cached = entry->cached;
+    return true;
+}
+
+void CBlockHashMemo::Set(const CBlockHeader& header, const uint256& hash, bool cached) const
+{
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->nVersion = header.nVersion;
+    entry->hashPrevBlock = header.hashPrevBlock;
+    entry->hashMerkleRoot = header.hashMerkleRoot;
+    entry->nTime = header.nTime;
+    entry->nBits = header.nBits;
+    entry->nNonce = header.nNonce;
+    entry->nChainId = header.nChainId;
+    entry->hash = hash;
+    entry->cached = cached;
+    std::atomic_store(&m_entry, std::shared_ptr<const Entry>(std::move(entry)));
+}
+
+bool DowsHashBatch(CBlockHeader& header, uint32_t nonce_begin, uint32_t count, const uint256& target, uint32_t& hashes)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_GETHASH, PROTOCOL_VERSION, data, 0, header);
+    assert(data.size() == DOWS_HEADER_SIZE);
+
+    uint32_t nonce;
+    uint256 hash;
+    if (!DowsHashBatch(data.data(), nonce_begin, count, target, nonce, hash, hashes)) {
+        header.nNonce = nonce_begin + hashes;
+        return false;
+    }
+    header.nNonce = nonce;
+    header.hashMemo.Set(header, hash, false);
+    return true;
+}
+
 uint256 CBlockHeader::GetPlainHash() const {
     return SerializeHash(*this);
 }
 
+// Always computes the hash, bypassing both the memo and the DOWS hash cache,
+// but remembers it so that passing the header on does not hash it again
 uint256 CBlockHeader::GetTestHash(bool debug) const
 {
-    return DowsHash(SerializeHash(*this), debug, true);
+    uint256 hash = DowsHash(SerializeHash(*this), debug, true);
+    hashMemo.Set(*this, hash, false);
+    return hash;
 }
 // } + 
 
@@ -26,7 +94,23 @@ uint256 CBlockHeader::GetTestHash(bool debug) const
 // { & 
 uint256 CBlockHeader::GetHash(bool debug) const
 {
-    return DowsHash(SerializeHash(*this), debug);
+    // { + 
+    uint256 hash;
+    bool cached;
+    if (!debug && hashMemo.Get(*this, hash, cached)) {
+        if (!cached) {
+            // Found by GetTestHash(), which leaves the DOWS hash cache alone;
+            // the header is in real use now, so the cache gets it after all
+            uint256 raw = SerializeHash(*this);
+            AddToDowsHashCache(raw, hash);
+            hashMemo.Set(*this, hash, true);
+        }
+        return hash;
+    }
+    hash = DowsHash(SerializeHash(*this), debug);
+    hashMemo.Set(*this, hash, true);
+    return hash;
+    // } + 
 }
 // } & 
 
@@ -10,6 +10,8 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <memory> // + 
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -18,6 +20,38 @@
  * of the block.
  */
 
+// { + 
+class CBlockHeader;
+
+/**
+ * Memoized PoW hash of a block header (memory only). It remembers the header
+ * fields it was computed from, so changing any of them, as a miner does with
+ * nNonce, invalidates it without anyone having to say so. Copies share it,
+ * and it is safe to read and replace from several threads.
+ */
+class CBlockHashMemo
+{
+public:
+    CBlockHashMemo() {}
+    CBlockHashMemo(const CBlockHashMemo& other) : m_entry(std::atomic_load(&other.m_entry)) {}
+    CBlockHashMemo& operator=(const CBlockHashMemo& other)
+    {
+        std::atomic_store(&m_entry, std::atomic_load(&other.m_entry));
+        return *this;
+    }
+
+    /** Set hash to the memoized hash of header, if there is one, and cached to whether it is in the DOWS hash cache too */
+    bool Get(const CBlockHeader& header, uint256& hash, bool& cached) const;
+    /** Remember hash as the hash of header */
+    void Set(const CBlockHeader& header, const uint256& hash, bool cached) const;
+    /** Forget the memoized hash */
+    void Clear() const { std::atomic_store(&m_entry, std::shared_ptr<const Entry>()); }
+
+private:
+    struct Entry;
+    mutable std::shared_ptr<const Entry> m_entry;
+};
+// } + 
 
 class CBlockHeader
 {
@@ -31,6 +65,9 @@ public:
     uint32_t nNonce;
     uint32_t nChainId; // + 
 
+    // memory only
+    CBlockHashMemo hashMemo; // + 
+
     CBlockHeader()
     {
         SetNull();
@@ -58,6 +95,7 @@ public:
         nBits = 0;
         nNonce = 0;
         nChainId = 0; // + 
+        hashMemo.Clear(); // + 
     }
 
     bool IsNull() const
@@ -121,12 +159,23 @@ public:
         block.nBits          = nBits;
         block.nNonce         = nNonce;
         block.nChainId       = nChainId; // + 
+        block.hashMemo       = hashMemo; // + 
         return block;
     }
 
     std::string ToString() const;
 };
 
+// { + 
+/**
+ * Search count nonces of header from nonce_begin on for a DOWS hash at most
+ * target, several at a time (see DowsHashBatch in hash.h). On success nNonce
+ * is the solution and its hash is memoized; otherwise nNonce is the next nonce
+ * to try. hashes is set to the number of nonces hashed.
+ */
+bool DowsHashBatch(CBlockHeader& header, uint32_t nonce_begin, uint32_t count, const uint256& target, uint32_t& hashes);
+// } + 
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
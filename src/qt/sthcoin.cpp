@@ -554,7 +554,6 @@ static void SetupUIArgs()
 #ifndef STHCOIN_QT_TEST
 int main(int argc, char *argv[])
 {
-    InitHashBase(); // 
     SetupEnvironment();
 
     std::unique_ptr<interfaces::Node> node = interfaces::MakeNode();
@@ -210,6 +210,9 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    // Binary and hex replies in the on-disk format need no decoding // + 
+    const bool raw = rf != RetFormat::JSON && RPCSerializationFlags() == 0; // + 
+    std::vector<uint8_t> raw_block; // + 
     {
         LOCK(cs_main);
         pblockindex = LookupBlockIndex(hash);
@@ -220,23 +223,25 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (raw ? !ReadRawBlockFromDisk(raw_block, pblockindex, Params().MessageStart()) : // & 
+                  !ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (!raw) // + 
+        ssBlock << block;
 
     switch (rf) {
     case RetFormat::BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock = raw ? std::string(raw_block.begin(), raw_block.end()) : ssBlock.str(); // & 
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RetFormat::HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = (raw ? HexStr(raw_block.begin(), raw_block.end()) : HexStr(ssBlock.begin(), ssBlock.end())) + "\n"; // & 
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
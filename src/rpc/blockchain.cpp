@@ -756,6 +756,22 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
+// { + 
+static std::vector<uint8_t> GetRawBlockChecked(const CBlockIndex* pblockindex)
+{
+    std::vector<uint8_t> block;
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    if (!ReadRawBlockFromDisk(block, pblockindex, Params().MessageStart())) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return block;
+}
+// } + 
+
 static UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -825,6 +841,15 @@ static UniValue getblock(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
 
+    // { + 
+    // Blocks are stored as they are sent with witnesses, so unless witnesses
+    // are to be left out their bytes can be returned without decoding them
+    if (verbosity <= 0 && RPCSerializationFlags() == 0) {
+        std::vector<uint8_t> block = GetRawBlockChecked(pblockindex);
+        return HexStr(block.begin(), block.end());
+    }
+    // } + 
+
     const CBlock block = GetBlockChecked(pblockindex);
 
     if (verbosity <= 0)
@@ -130,23 +130,22 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
         //  & {
-        nCount = 0;
         pblock->nNonce = ((unsigned int) GetRandInt (2097151)) << 11;  // 2097151 = 2^21 = 2 ^ (32 - Log_2 (nInnerLoopCount))
-        while (nMaxTries > 0 && nCount < nInnerLoopCount && !CheckProofOfWork(pblock->GetTestHash(), pblock->nBits, Params().GetConsensus())) {
-            ++ nCount;
-            ++ pblock->nNonce;
-            --nMaxTries;
-            if (nMaxTries % 10000 == 0) {
-                LogPrint (BCLog::MINING, "\tHeight = %d, target = %X, nonce = %08X, extra nonce = %08X, try = %llu\n",
-                           nHeight + 1, pblock->nBits, pblock->nNonce, nExtraNonce, nMaxTries);
-            }
-        }
-        if (nMaxTries == 0) {
+        // { + 
+        uint32_t nHashes;
+        arith_uint256 bnTarget = arith_uint256().SetCompact(pblock->nBits);
+        bool fFound = DowsHashBatch(*pblock, pblock->nNonce, std::min<uint64_t>(nMaxTries, nInnerLoopCount), ArithToUint256(bnTarget), nHashes);
+        nCount = nHashes - fFound;
+        nMaxTries -= nCount;
+        LogPrint (BCLog::MINING, "\tHeight = %d, target = %X, nonce = %08X, extra nonce = %08X, try = %llu\n",
+                   nHeight + 1, pblock->nBits, pblock->nNonce, nExtraNonce, nMaxTries);
+        if (!fFound && nMaxTries == 0) {
             break;
         }
-        if (nCount == nInnerLoopCount) {
+        if (!fFound) {
             continue;
         }
+        // } + 
         //  & }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
         if (!ProcessNewBlock(Params(), shared_pblock, true, nullptr))
@@ -197,6 +196,64 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
     return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false);
 }
 
+// { + 
+static UniValue setgenerate(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "setgenerate generate ( genproclimit \"address\" )\n"
+            "\nStart or stop the built-in miner.\n"
+            "\nArguments:\n"
+            "1. generate         (boolean, required) Set to true to start mining, false to stop.\n"
+            "2. genproclimit     (numeric, optional) The number of miner threads, -1 for one per core (default: -genproclimit).\n"
+            "3. \"address\"        (string, optional) The address to send the newly generated sthcoin to (default: -genaddress).\n"
+            "\nExamples:\n"
+            "\nMine on four threads\n"
+            + HelpExampleCli("setgenerate", "true 4 \"myaddress\"") +
+            "\nStop mining\n"
+            + HelpExampleCli("setgenerate", "false")
+        );
+
+    bool fGenerate = request.params[0].get_bool();
+    int nThreads = gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (!request.params[1].isNull()) {
+        nThreads = request.params[1].get_int();
+    }
+    std::string address = gArgs.GetArg("-genaddress", "");
+    if (!request.params[2].isNull()) {
+        address = request.params[2].get_str();
+    }
+
+    CScript coinbase_script;
+    if (fGenerate && nThreads != 0) {
+        CTxDestination destination = DecodeDestination(address);
+        if (!IsValidDestination(destination)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Error: Invalid address");
+        }
+        coinbase_script = GetScriptForDestination(destination);
+    }
+
+    GenerateSthcoins(fGenerate, nThreads, coinbase_script, Params());
+    return NullUniValue;
+}
+
+static UniValue getgenerate(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getgenerate\n"
+            "\nReturn if the built-in miner is running.\n"
+            "\nResult\n"
+            "true|false      (boolean) If the built-in miner is running\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getgenerate", "")
+            + HelpExampleRpc("getgenerate", "")
+        );
+
+    return GetMinerThreads() > 0;
+}
+// } + 
+
 static UniValue getmininginfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -212,6 +269,25 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"generate\": true|false      (boolean) If the built-in miner is running\n"
+            "  \"genproclimit\": n           (numeric) The number of built-in miner threads\n"
+            "  \"hashespersec\": n           (numeric) The hash rate of the built-in miner\n"
+            "  \"dowscache\": {              (json object) DOWS hash cache usage\n"
+            "     \"entries\": n,             (numeric) Number of cached hashes\n"
+            "     \"pinned\": n,              (numeric) Cached hashes of active chain headers, never evicted\n"
+            "     \"capacity\": n,            (numeric) Number of hashes the cache can hold\n"
+            "     \"usage\": n,               (numeric) Memory used by the cache in bytes\n"
+            "     \"hits\": n,                (numeric) Lookups answered from the cache\n"
+            "     \"misses\": n,              (numeric) Lookups that had to compute the hash\n"
+            "     \"inserts\": n,             (numeric) Hashes written to the cache\n"
+            "     \"evictions\": n,           (numeric) Hashes evicted to make room\n"
+            "     \"dropped\": n,             (numeric) Hashes not cached because only pinned ones were in their place\n"
+            "     \"contention\": n           (numeric) Writes that had to wait for another writer\n"
+            "  },\n"
+            "  \"dowsprogramcache\": {       (json object) Compiled DOWS programs reused by hashing threads\n"
+            "     \"hits\": n,                (numeric) Hashes that found their program compiled\n"
+            "     \"misses\": n               (numeric) Hashes that had to generate and compile it\n"
+            "  },\n"
             "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
             "}\n"
             "\nExamples:\n"
@@ -230,6 +306,30 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("networkhashps",    getnetworkhashps(request));
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
+    // { + 
+    obj.pushKV("generate",         GetMinerThreads() > 0);
+    obj.pushKV("genproclimit",     GetMinerThreads());
+    obj.pushKV("hashespersec",     GetMinerHashesPerSec());
+    CDowsHashCache::Stats dows_cache = GetDowsHashCacheStats();
+    UniValue dows_cache_obj(UniValue::VOBJ);
+    dows_cache_obj.pushKV("entries",    dows_cache.entries);
+    dows_cache_obj.pushKV("pinned",     dows_cache.pinned);
+    dows_cache_obj.pushKV("capacity",   dows_cache.capacity);
+    dows_cache_obj.pushKV("usage",      (uint64_t)dows_cache.usage);
+    dows_cache_obj.pushKV("hits",       dows_cache.hits);
+    dows_cache_obj.pushKV("misses",     dows_cache.misses);
+    dows_cache_obj.pushKV("inserts",    dows_cache.inserts);
+    dows_cache_obj.pushKV("evictions",  dows_cache.evictions);
+    dows_cache_obj.pushKV("dropped",    dows_cache.dropped);
+    dows_cache_obj.pushKV("contention", dows_cache.contention);
+    obj.pushKV("dowscache",        dows_cache_obj);
+    uint64_t program_hits, program_misses;
+    GetDowsProgramCacheStats(program_hits, program_misses);
+    UniValue dows_program_obj(UniValue::VOBJ);
+    dows_program_obj.pushKV("hits",     program_hits);
+    dows_program_obj.pushKV("misses",   program_misses);
+    obj.pushKV("dowsprogramcache", dows_program_obj);
+    // } + 
     obj.pushKV("warnings",         GetWarnings("statusbar"));
     return obj;
 }
@@ -955,6 +1055,8 @@ static const CRPCCommand commands[] =
 
 
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
+    { "generating",         "setgenerate",            &setgenerate,            {"generate","genproclimit","address"} }, // + 
+    { "generating",         "getgenerate",            &getgenerate,            {} }, // + 
 
     { "hidden",             "estimatefee",            &estimatefee,            {} },
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
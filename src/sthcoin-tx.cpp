@@ -836,7 +836,6 @@ static int CommandLineRawTx(int argc, char* argv[])
 
 int main(int argc, char* argv[])
 {
-    InitHashBase(); // 
     SetupEnvironment();
 
     try {
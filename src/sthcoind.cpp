@@ -185,7 +185,6 @@ static bool AppInit(int argc, char* argv[])
 
 int main(int argc, char* argv[])
 {
-    InitHashBase(); // 
     SetupEnvironment();
 
     // Connect sthcoind signal handlers
@@ -4,6 +4,7 @@
 
 #include <coins.h>
 #include <script/standard.h>
+#include <txdb.h> // + 
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
@@ -52,7 +53,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -63,7 +64,7 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            it = erase ? mapCoins.erase(it) : std::next(it);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -210,7 +211,11 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Sync();
+                } else {
+                    stack[flushIndex]->Flush();
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -855,4 +860,101 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    SetDataDir("ccoins_prefetch");
+    ClearDatadirCache();
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCacheTest tip(&db);
+    CCoinsViewCacheTest view(&tip);
+
+    // Enough coins for the database reads to be spread over threads
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCache writer(&db);
+        for (int i = 0; i < 1000; ++i) {
+            outpoints.emplace_back(InsecureRand256(), i % 4);
+            writer.AddCoin(outpoints.back(), Coin(CTxOut(1 + InsecureRandRange(1000), CScript() << OP_TRUE), i, false), false);
+        }
+        writer.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(writer.Flush());
+    }
+
+    // A quarter of them are in the tip cache already, and some do not exist
+    for (size_t i = 0; i < outpoints.size(); i += 4) {
+        tip.AccessCoin(outpoints[i]);
+    }
+    for (int i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+    }
+
+    BOOST_CHECK_EQUAL(view.Prefetch(outpoints), 850U);
+    for (const COutPoint& outpoint : outpoints) {
+        Coin expected;
+        bool found = db.GetCoin(outpoint, expected);
+        BOOST_CHECK_EQUAL(view.HaveCoinInCache(outpoint), found);
+        BOOST_CHECK_EQUAL(tip.HaveCoinInCache(outpoint), found);
+        if (found) {
+            BOOST_CHECK(view.AccessCoin(outpoint) == expected);
+        }
+    }
+    view.SelfTest();
+    tip.SelfTest();
+
+    // Only what was not found is asked for again
+    BOOST_CHECK_EQUAL(view.Prefetch(outpoints), 100U);
+
+    std::vector<Coin> coins;
+    BOOST_CHECK_EQUAL(db.GetCoins(outpoints, coins), outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        Coin expected;
+        BOOST_CHECK_EQUAL(!coins[i].IsSpent(), db.GetCoin(outpoints[i], expected));
+        BOOST_CHECK(coins[i] == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    COutPoint kept(InsecureRand256(), 0);
+    COutPoint spent(InsecureRand256(), 1);
+    COutPoint unknown(InsecureRand256(), 2);
+    cache.AddCoin(kept, Coin(CTxOut(VALUE1, CScript() << OP_TRUE), 1, false), false);
+    cache.AddCoin(spent, Coin(CTxOut(VALUE2, CScript() << OP_TRUE), 1, false), false);
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+
+    // Both coins reached the base and stay cached, unmodified
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(kept, coin) && coin.out.nValue == VALUE1);
+    BOOST_CHECK(base.GetCoin(spent, coin) && coin.out.nValue == VALUE2);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    BOOST_CHECK_EQUAL(cache.GetBestBlock(), base.GetBestBlock());
+    cache.SelfTest();
+
+    // Spending a synced coin has to reach the base too, as it is no longer
+    // FRESH, and the spent entry is not kept afterwards
+    BOOST_CHECK(cache.SpendCoin(spent));
+    BOOST_CHECK(!cache.HaveCoin(unknown));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!base.GetCoin(spent, coin) || coin.IsSpent());
+    BOOST_CHECK(!cache.HaveCoinInCache(spent));
+    BOOST_CHECK(!cache.HaveCoinInCache(unknown));
+    BOOST_CHECK(cache.HaveCoinInCache(kept));
+    cache.SelfTest();
+
+    // A clean entry can be uncached, and Flush() still empties the cache
+    cache.Uncache(kept);
+    BOOST_CHECK(!cache.HaveCoinInCache(kept));
+    BOOST_CHECK(cache.AccessCoin(kept).out.nValue == VALUE1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(base.GetCoin(kept, coin) && coin.out.nValue == VALUE1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
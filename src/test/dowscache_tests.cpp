@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The Sthcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dowscache.h>
+#include <test/test_sthcoin.h>
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(dowscache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(dowscache_get_put)
+{
+    CDowsHashCache cache;
+    uint256 raw = InsecureRand256(), dows = InsecureRand256(), out;
+
+    // Before setup nothing is stored
+    cache.Put(raw, dows);
+    BOOST_CHECK(!cache.Get(raw, out));
+
+    BOOST_CHECK_EQUAL(cache.setup(1000), 1024U);
+    BOOST_CHECK(!cache.Get(raw, out));
+    cache.Put(raw, dows);
+    BOOST_CHECK(cache.Get(raw, out));
+    BOOST_CHECK(out == dows);
+
+    // The first value written for a key is kept
+    cache.Put(raw, InsecureRand256());
+    BOOST_CHECK(cache.Get(raw, out));
+    BOOST_CHECK(out == dows);
+
+    CDowsHashCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.entries, 1U);
+    BOOST_CHECK_EQUAL(stats.inserts, 1U);
+    BOOST_CHECK_EQUAL(stats.hits, 2U);
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(dowscache_replaces_oldest)
+{
+    CDowsHashCache cache;
+    size_t capacity = cache.setup(0);
+    std::vector<std::pair<uint256, uint256>> entries;
+    for (size_t i = 0; i < capacity * 4; ++i) {
+        entries.emplace_back(InsecureRand256(), InsecureRand256());
+        cache.Put(entries.back().first, entries.back().second);
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, capacity);
+
+    // Whatever is found must be what was stored, and the newest entries survive
+    size_t found = 0, newest = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint256 out;
+        if (cache.Get(entries[i].first, out)) {
+            BOOST_CHECK(out == entries[i].second);
+            ++found;
+            newest += i >= entries.size() - capacity;
+        }
+    }
+    BOOST_CHECK_EQUAL(found, capacity);
+    BOOST_CHECK(newest > capacity / 2);
+
+    size_t visited = 0;
+    cache.ForEach([&](const uint256& raw, const uint256& dows) {
+        uint256 out;
+        BOOST_CHECK(cache.Get(raw, out) && out == dows);
+        ++visited;
+    });
+    BOOST_CHECK_EQUAL(visited, capacity);
+}
+
+BOOST_AUTO_TEST_CASE(dowscache_levels)
+{
+    CDowsHashCache cache;
+    size_t capacity = cache.setup_bytes(1 << 20);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= (1 << 20));
+    BOOST_CHECK_EQUAL(cache.GetStats().capacity, capacity);
+
+    // Pin a quarter of a full cache and rank another quarter above the rest
+    std::vector<uint256> active, indexed;
+    for (size_t i = 0; i < capacity; ++i) {
+        uint256 raw = InsecureRand256();
+        cache.Put(raw, raw);
+        if (i % 4 == 0 && cache.SetLevel(raw, CDowsHashCache::ACTIVE)) {
+            active.push_back(raw);
+        } else if (i % 4 == 1 && cache.SetLevel(raw, CDowsHashCache::INDEXED)) {
+            indexed.push_back(raw);
+        }
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().pinned, active.size());
+    BOOST_CHECK(!cache.SetLevel(InsecureRand256(), CDowsHashCache::ACTIVE));
+
+    // Churn through junk: pinned entries all survive, indexed ones mostly do
+    for (size_t i = 0; i < capacity; ++i) {
+        uint256 raw = InsecureRand256();
+        cache.Put(raw, raw);
+    }
+    size_t indexed_left = 0;
+    uint256 out;
+    for (const uint256& raw : active) {
+        BOOST_CHECK(cache.Get(raw, out) && out == raw);
+    }
+    for (const uint256& raw : indexed) {
+        indexed_left += cache.Get(raw, out);
+    }
+    BOOST_CHECK(indexed_left > indexed.size() * 3 / 4);
+
+    // Unpinned entries can be evicted again
+    for (const uint256& raw : active) {
+        BOOST_CHECK(cache.SetLevel(raw, CDowsHashCache::TRANSIENT));
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().pinned, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(dowscache_concurrent)
+{
+    // Readers must never see a torn or foreign value while writers replace slots
+    CDowsHashCache cache;
+    cache.setup(256);
+    std::vector<std::pair<uint256, uint256>> entries;
+    for (int i = 0; i < 4096; ++i) {
+        entries.emplace_back(InsecureRand256(), InsecureRand256());
+    }
+
+    std::atomic<int> bad(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < 20; ++round) {
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    uint256 out;
+                    if (t % 2) {
+                        cache.Put(entries[i].first, entries[i].second);
+                    } else if (cache.Get(entries[i].first, out) && out != entries[i].second) {
+                        ++bad;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(bad, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,14 +2,26 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <test/data/dows_vectors.json.h>
+
+#include <arith_uint256.h>
 #include <hash.h>
+#include <primitives/block.h>
+#include <streams.h>
 #include <utilstrencodings.h>
+#include <version.h>
 #include <test/test_sthcoin.h>
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
 
+#include <univalue.h>
+
+extern UniValue read_json(const std::string& jsondata);
+
 BOOST_FIXTURE_TEST_SUITE(hash_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(murmurhash3)
@@ -147,4 +159,212 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dows_native_engine)
+{
+    // The native engine must reproduce the Lua reference bit for bit
+    const DowsEngine engine = g_dows_engine;
+    for (int i = 0; i < 32; ++i) {
+        uint256 raw = InsecureRand256();
+        g_dows_engine = DowsEngine::LUA;
+        uint256 lua = DowsHash(raw, false, true);
+        g_dows_engine = DowsEngine::NATIVE;
+        BOOST_CHECK_EQUAL(DowsHash(raw, false, true), lua);
+    }
+    g_dows_engine = engine;
+
+    DowsEngine parsed;
+    BOOST_CHECK(ParseDowsEngine("lua", parsed) && parsed == DowsEngine::LUA);
+    BOOST_CHECK(ParseDowsEngine("check", parsed) && parsed == DowsEngine::CHECK);
+    BOOST_CHECK(ParseDowsEngine("native", parsed) && parsed == DowsEngine::NATIVE);
+    BOOST_CHECK(!ParseDowsEngine("jit", parsed));
+}
+
+BOOST_AUTO_TEST_CASE(dows_vectors)
+{
+    // Known DOWS hashes of serialized headers, checked on every engine
+    UniValue tests = read_json(std::string(json_tests::dows_vectors, json_tests::dows_vectors + sizeof(json_tests::dows_vectors)));
+    const DowsEngine engine = g_dows_engine;
+    for (unsigned int idx = 0; idx < tests.size(); idx++) {
+        UniValue test = tests[idx];
+        std::string strTest = test.write();
+        if (test.size() < 2) // Allow for extra stuff (useful for comments)
+            continue;
+
+        std::vector<unsigned char> data = ParseHex(test[0].get_str());
+        uint256 expected = uint256S(test[1].get_str());
+        CBlockHeader header;
+        CDataStream(data, SER_NETWORK, PROTOCOL_VERSION) >> header;
+        BOOST_CHECK_MESSAGE(header.GetPlainHash() == Hash(data.begin(), data.end()), strTest);
+        for (DowsEngine e : {DowsEngine::NATIVE, DowsEngine::LUA}) {
+            g_dows_engine = e;
+            BOOST_CHECK_MESSAGE(header.GetTestHash() == expected, strTest);
+        }
+    }
+    g_dows_engine = engine;
+}
+
+BOOST_AUTO_TEST_CASE(dows_shuffle_lanes)
+{
+    // Interleaving shuffles on lanes must not change any of them, whatever the
+    // count and however their lengths differ
+    BOOST_REQUIRE(InitHashBase());
+    const size_t count = 3 * DOWS_BATCH_LANES + 1;
+    std::vector<DowsProgram> programs(count);
+    std::vector<uint256> expected, shuffled;
+    std::vector<uint8_t*> hashes;
+    for (size_t i = 0; i < count; ++i) {
+        uint256 h = InsecureRand256();
+        uint64_t seed = 0, incr = 0;
+        DowsMixSeed(h.begin(), seed, incr);
+        MakeHashProgram(seed, incr, programs[i]);
+        shuffled.push_back(h);
+        ShuffleHash256(programs[i], h.begin());
+        expected.push_back(h);
+    }
+    for (uint256& h : shuffled) {
+        hashes.push_back(h.begin());
+    }
+    ShuffleHash256Lanes(programs.data(), hashes.data(), count);
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(shuffled[i], expected[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dows_thread_context)
+{
+    // Threads reuse their hashing context across programs without leaking state
+    std::vector<uint256> raws, expected;
+    for (int i = 0; i < 16; ++i) {
+        raws.push_back(InsecureRand256());
+        expected.push_back(DowsHash(raws.back(), false, true));
+    }
+
+    const DowsEngine engine = g_dows_engine;
+    g_dows_engine = DowsEngine::LUA;
+    std::atomic<int> bad(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < raws.size(); ++i) {
+                size_t n = (i + t * 5) % raws.size();
+                if (DowsHash(raws[n], false, true) != expected[n]) {
+                    ++bad;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    g_dows_engine = engine;
+    BOOST_CHECK_EQUAL(bad, 0);
+}
+
+BOOST_AUTO_TEST_CASE(dows_program_cache)
+{
+    // Hashing the same input again reuses its program on either engine, and
+    // a reused program gives the same hash
+    const DowsEngine engine = g_dows_engine;
+    uint64_t hits, misses, hits_before, misses_before;
+    for (DowsEngine e : {DowsEngine::NATIVE, DowsEngine::LUA}) {
+        g_dows_engine = e;
+        uint256 raw = InsecureRand256();
+        GetDowsProgramCacheStats(hits_before, misses_before);
+        uint256 first = DowsHash(raw, false, true);
+        BOOST_CHECK_EQUAL(DowsHash(raw, false, true), first);
+        GetDowsProgramCacheStats(hits, misses);
+        BOOST_CHECK_EQUAL(hits - hits_before, 1U);
+        BOOST_CHECK_EQUAL(misses - misses_before, 1U);
+    }
+
+    // The least recently used program makes room for new ones
+    g_dows_engine = DowsEngine::NATIVE;
+    std::vector<uint256> raws;
+    for (int i = 0; i <= DOWS_PROGRAM_CACHE_SIZE; ++i) {
+        raws.push_back(InsecureRand256());
+        DowsHash(raws.back(), false, true);
+    }
+    GetDowsProgramCacheStats(hits_before, misses_before);
+    DowsHash(raws.back(), false, true);
+    DowsHash(raws.front(), false, true);
+    GetDowsProgramCacheStats(hits, misses);
+    BOOST_CHECK_EQUAL(hits - hits_before, 1U);
+    BOOST_CHECK_EQUAL(misses - misses_before, 1U);
+    g_dows_engine = engine;
+}
+
+BOOST_AUTO_TEST_CASE(pcg32_advance)
+{
+    // Jumping ahead must land on the same output as stepping
+    for (uint64_t delta : {0, 1, 2, 3, 1000, 65537}) {
+        CPCG32 stepped(599128178199824553ull, 2055286011627441373ull);
+        CPCG32 jumped(599128178199824553ull, 2055286011627441373ull);
+        for (uint64_t i = 0; i < delta; ++i) {
+            stepped.pcg32();
+        }
+        jumped.advance(delta);
+        BOOST_CHECK_EQUAL(jumped.pcg32(), stepped.pcg32());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_hash_memo)
+{
+    CBlock block;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+    uint256 hash = block.GetHash();
+    uint256 memo;
+    bool cached;
+    BOOST_CHECK(block.hashMemo.Get(block, memo, cached) && memo == hash && cached);
+
+    // Copies carry the hash along
+    CBlockHeader header = block.GetBlockHeader();
+    BOOST_CHECK(header.hashMemo.Get(header, memo, cached) && memo == hash);
+    BOOST_CHECK_EQUAL(CBlock(header).GetHash(), hash);
+
+    // Any change to the header makes it stale
+    block.nNonce++;
+    BOOST_CHECK(!block.hashMemo.Get(block, memo, cached));
+    uint256 next = block.GetTestHash();
+    BOOST_CHECK(next != hash);
+    BOOST_CHECK(block.hashMemo.Get(block, memo, cached) && memo == next && !cached);
+    BOOST_CHECK_EQUAL(block.GetHash(), next);
+    BOOST_CHECK(block.hashMemo.Get(block, memo, cached) && cached);
+    BOOST_CHECK_EQUAL(header.GetHash(), hash);
+
+    block.SetNull();
+    BOOST_CHECK(!block.hashMemo.Get(block, memo, cached));
+}
+
+BOOST_AUTO_TEST_CASE(dows_hash_batch)
+{
+    CBlockHeader header;
+    header.hashPrevBlock = InsecureRand256();
+    header.nNonce = InsecureRand32();
+    const uint32_t nonce_begin = header.nNonce;
+
+    // Hash a few nonces one by one and take one of the hashes as the target
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 2 * DOWS_BATCH_LANES + 3; ++i) {
+        header.nNonce = nonce_begin + i;
+        hashes.push_back(header.GetTestHash());
+    }
+    const uint256 target = hashes[DOWS_BATCH_LANES + 1];
+    size_t first = 0;
+    while (UintToArith256(hashes[first]) > UintToArith256(target)) {
+        ++first;
+    }
+
+    uint32_t tried;
+    BOOST_CHECK(DowsHashBatch(header, nonce_begin, hashes.size(), target, tried));
+    BOOST_CHECK_EQUAL(tried, first + 1);
+    BOOST_CHECK_EQUAL(header.nNonce, nonce_begin + first);
+    BOOST_CHECK_EQUAL(header.GetHash(), hashes[first]);
+
+    // Nothing solves a zero target
+    BOOST_CHECK(!DowsHashBatch(header, nonce_begin, hashes.size(), uint256(), tried));
+    BOOST_CHECK_EQUAL(tried, hashes.size());
+    BOOST_CHECK_EQUAL(header.nNonce, nonce_begin + hashes.size());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -83,4 +83,37 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(average_difficulty_memo)
+{
+    std::vector<CBlockIndex> blocks(5000);
+    std::vector<uint256> hashes(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        hashes[i] = InsecureRand256();
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nBits = 0x1d000000 | InsecureRandRange(0x10000);
+        blocks[i].BuildSkip();
+    }
+
+    for (int j = 0; j < 1000; j++) {
+        const CBlockIndex& tip = blocks[1 + InsecureRandRange(blocks.size() - 1)];
+        int height = InsecureRandRange(tip.nHeight);
+
+        // Without a hash the walk is never remembered
+        CBlockIndex unhashed = tip;
+        unhashed.phashBlock = nullptr;
+        arith_uint256 expected;
+        const CBlockIndex* ancestor = unhashed.GetAncestorAndAverageDifficulty(height, expected);
+        BOOST_CHECK(ancestor == tip.GetAncestor(height));
+
+        for (int k = 0; k < 2; k++) {
+            arith_uint256 diffBits;
+            BOOST_CHECK(tip.GetAncestorAndAverageDifficulty(height, diffBits) == ancestor);
+            BOOST_CHECK(diffBits == expected);
+        }
+    }
+    ClearAverageDifficultyMemo();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -55,6 +55,7 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitDowsHashCache(); // + 
     fCheckBlockIndex = true;
     SelectParams(chainName);
     noui_connect();
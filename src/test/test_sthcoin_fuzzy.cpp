@@ -20,11 +20,13 @@
 #include <version.h>
 #include <pubkey.h>
 #include <blockencodings.h>
+#include <hash.h> // + 
 
 #include <stdint.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <cassert> // + 
 #include <memory>
 #include <vector>
 
@@ -49,6 +51,7 @@ enum TEST_ID {
     CTXOUTCOMPRESSOR_DESERIALIZE,
     BLOCKTRANSACTIONS_DESERIALIZE,
     BLOCKTRANSACTIONSREQUEST_DESERIALIZE,
+    DOWS_ENGINES, // + 
     TEST_ID_END
 };
 
@@ -269,6 +272,37 @@ static int test_one_input(std::vector<uint8_t> buffer) {
 
             break;
         }
+        // { + 
+        case DOWS_ENGINES:
+        {
+            // Differential check of the optimized DOWS engines against the Lua reference
+            uint256 raw;
+            try
+            {
+                ds >> raw;
+            } catch (const std::ios_base::failure& e) {return 0;}
+
+            const DowsEngine engine = g_dows_engine;
+            g_dows_engine = DowsEngine::LUA;
+            uint256 lua = DowsHash(raw, false, true);
+            g_dows_engine = DowsEngine::NATIVE;
+            uint256 native = DowsHash(raw, false, true);
+            g_dows_engine = engine;
+            assert(native == lua);
+
+            uint64_t seed = 0, incr = 0;
+            DowsMixSeed(raw.begin(), seed, incr);
+            DowsProgram programs[2];
+            MakeHashProgram(seed, incr, programs[0]);
+            programs[1] = programs[0];
+            uint256 single = raw, lanes[2] = {raw, raw};
+            uint8_t* hashes[2] = {lanes[0].begin(), lanes[1].begin()};
+            ShuffleHash256(programs[0], single.begin());
+            ShuffleHash256Lanes(programs, hashes, 2);
+            assert(lanes[0] == single && lanes[1] == single);
+            break;
+        }
+        // } + 
         default:
             return 0;
     }
@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <hash.h>
 #include <miner.h>
 #include <pow.h>
 #include <random.h>
@@ -181,4 +182,74 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(precompute_block_hashes)
+{
+    std::vector<CBlockHeader> headers(20);
+    for (CBlockHeader& header : headers) {
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nNonce = InsecureRand32();
+    }
+
+    int script_check_threads = nScriptCheckThreads;
+    for (int threads : {0, 3}) {
+        nScriptCheckThreads = threads;
+        std::vector<uint256> hashes;
+        PrecomputeBlockHashes(headers, hashes);
+        BOOST_CHECK_EQUAL(hashes.size(), headers.size());
+        for (size_t i = 0; i < headers.size(); ++i) {
+            BOOST_CHECK(hashes[i] == headers[i].GetTestHash());
+        }
+    }
+    nScriptCheckThreads = script_check_threads;
+}
+
+BOOST_AUTO_TEST_CASE(read_block_matches_index)
+{
+    auto pblock = GoodBlock(Params().GenesisBlock().GetHash());
+    BOOST_CHECK(ProcessNewBlock(Params(), pblock, true, nullptr));
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(pblock->GetHash());
+    }
+    BOOST_REQUIRE(pindex);
+
+    // The header is checked against the index, without hashing it again
+    CDowsHashCache::Stats before = GetDowsHashCacheStats();
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+    CDowsHashCache::Stats after = GetDowsHashCacheStats();
+    BOOST_CHECK_EQUAL(after.hits + after.misses, before.hits + before.misses);
+
+    // An index entry that does not describe the stored header is refused
+    CBlockIndex other = *pindex;
+    other.nNonce ^= 1;
+    BOOST_CHECK(!ReadBlockFromDisk(block, &other, Params().GetConsensus()));
+}
+
+BOOST_AUTO_TEST_CASE(read_raw_block_matches_index)
+{
+    auto pblock = GoodBlock(Params().GenesisBlock().GetHash());
+    BOOST_CHECK(ProcessNewBlock(Params(), pblock, true, nullptr));
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(pblock->GetHash());
+    }
+    BOOST_REQUIRE(pindex);
+
+    // The stored bytes are the block as sent with witnesses
+    std::vector<uint8_t> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, Params().MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *pblock;
+    BOOST_CHECK(raw == std::vector<uint8_t>(ss.begin(), ss.end()));
+
+    CBlockIndex other = *pindex;
+    other.nNonce ^= 1;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &other, Params().MessageStart()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
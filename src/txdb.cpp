@@ -16,6 +16,11 @@
 
 #include <stdint.h>
 
+#include <atomic> // + 
+#include <exception> // + 
+#include <mutex> // + 
+#include <thread> // + 
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -61,6 +66,48 @@ bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+// { + 
+// A cold cache makes each lookup a disk read, so they are spread over threads
+size_t CCoinsViewDB::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const
+{
+    coins.assign(outpoints.size(), Coin());
+    std::atomic<size_t> next(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto read_coins = [&] {
+        try {
+            for (size_t i = next++; i < outpoints.size(); i = next++) {
+                if (!db.Read(CoinEntry(&outpoints[i]), coins[i])) {
+                    coins[i].Clear();
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            next = outpoints.size();
+        }
+    };
+
+    // The calling thread takes its share
+    size_t helpers = std::min(COINS_DB_READ_THREADS, outpoints.size() / COINS_DB_READS_PER_THREAD);
+    std::vector<std::thread> threads;
+    threads.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+        threads.emplace_back(read_coins);
+    }
+    read_coins();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return outpoints.size();
+}
+// } + 
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
     return db.Exists(CoinEntry(&outpoint));
 }
@@ -80,7 +127,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { // & 
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -116,7 +163,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld); // & 
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -259,8 +306,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                // Construct block index object. The record is keyed by its block
+                // hash, so take it from there instead of recomputing the DOWS hash
+                // of every header; LoadBlockIndexDB spot-checks the most recent ones.
+                CBlockIndex* pindexNew = insertBlockIndex(key.second); // 
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -44,6 +44,8 @@
 
 #include <future>
 #include <sstream>
+#include <thread> // + 
+#include <unordered_set> // + 
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -229,6 +231,7 @@ bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+int nCheckBlockIndexPow = DEFAULT_CHECKBLOCKINDEXPOW; // + 
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -1074,7 +1077,8 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+// { + 
+static bool ReadBlockDataFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
@@ -1090,6 +1094,14 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
+    return true;
+}
+// } + 
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockDataFromDisk(block, pos)) // & 
+        return false; // + 
 
     // Check the header
     uint256 hash = block.GetHash();
@@ -1109,18 +1121,23 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
         blockPos = pindex->GetBlockPos();
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    // { + 
+    // The index entry was only added once the header's proof of work checked
+    // out, so a header with the same plain SHA256d hash needs no DOWS hash.
+    // VerifyDB() redoes the proof of work for the blocks it checks.
+    if (!ReadBlockDataFromDisk(block, blockPos))
         return false;
 
     uint256 hash1, hash2;
-    hash1 = block.GetHash (true);
-    hash2 = pindex->GetBlockHash();
+    hash1 = block.GetPlainHash();
+    hash2 = pindex->GetPlainBlockHash();
     if (hash1 != hash2) {
-        LogPrint (BCLog::HASH, "\t%s\n\t%s\n\t%s\n\t%s\n", hash1.ToString (), block.GetPlainHash().ToString (),
-            hash2.ToString (), pindex->GetPlainBlockHash().ToString ()); // + 
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+        LogPrint (BCLog::HASH, "\t%s\n\t%s\n", hash1.ToString (), hash2.ToString ());
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetPlainHash() doesn't match index for %s at %s",
                      pindex->ToString(), pindex->GetBlockPos().ToString());
     }
+    block.hashMemo.Set(block, pindex->GetBlockHash(), true);
+    // } + 
     return true;
 }
 
@@ -1167,7 +1184,16 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
         block_pos = pindex->GetBlockPos();
     }
 
-    return ReadRawBlockFromDisk(block, block_pos, message_start);
+    // { + 
+    if (!ReadRawBlockFromDisk(block, block_pos, message_start))
+        return false;
+
+    // The same check as ReadBlockFromDisk() makes, on the header bytes as stored
+    if (block.size() < DOWS_HEADER_SIZE || Hash(block.begin(), block.begin() + DOWS_HEADER_SIZE) != pindex->GetPlainBlockHash()) {
+        return error("%s: header doesn't match index for %s at %s", __func__, pindex->ToString(), block_pos.ToString());
+    }
+    return true;
+    // } + 
 }
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
@@ -1821,6 +1847,9 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
 
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
+static int64_t nTimePrefetch = 0; // + 
+static int64_t nPrefetchInputs = 0; // + 
+static int64_t nPrefetchCached = 0; // + 
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -2020,6 +2049,35 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
+    // { + 
+    // Load the coins the block spends from earlier blocks before the loop below
+    // asks for them one by one, so that a cold cache costs parallel database
+    // reads instead of one synchronous read per input
+    std::vector<COutPoint> prevouts;
+    {
+        std::unordered_set<uint256, SaltedTxidHasher> created;
+        created.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx) {
+            if (!tx->IsCoinBase()) {
+                for (const CTxIn& txin : tx->vin) {
+                    if (!created.count(txin.prevout.hash)) {
+                        prevouts.push_back(txin.prevout);
+                    }
+                }
+            }
+            created.insert(tx->GetHash());
+        }
+    }
+    int64_t nTimePrefetchStart = nTime2;
+    size_t nPrefetchReads = view.Prefetch(prevouts);
+    nTime2 = GetTimeMicros(); nTimePrefetch += nTime2 - nTimePrefetchStart;
+    nPrefetchInputs += prevouts.size();
+    nPrefetchCached += prevouts.size() - nPrefetchReads;
+    LogPrint(BCLog::BENCH, "    - Prefetch %u inputs: %.2fms, %.1f%% cached [%.2fs (%.2fms/blk), %.1f%% cached]\n", (unsigned)prevouts.size(), MILLI * (nTime2 - nTimePrefetchStart),
+        prevouts.empty() ? 100.0 : 100.0 * (prevouts.size() - nPrefetchReads) / prevouts.size(), nTimePrefetch * MICRO, nTimePrefetch * MILLI / nBlocksTotal,
+        nPrefetchInputs == 0 ? 100.0 : 100.0 * nPrefetchCached / nPrefetchInputs);
+    // } + 
+
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
@@ -2185,6 +2243,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        // { + 
+        // Only a cache near or over its limit is emptied. Otherwise the coins are
+        // written out but stay cached, which makes it cheap to do on every
+        // periodic write, so a crash does not have to replay many blocks.
+        bool fEvictCache = fCacheLarge || fCacheCritical;
+        bool fSyncCache = fDoFullFlush || fPeriodicWrite;
+        // } + 
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -2216,7 +2281,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
-        if (fDoFullFlush && !pcoinsTip->GetBestBlock().IsNull()) {
+        if (fSyncCache && !pcoinsTip->GetBestBlock().IsNull()) { // & 
             // Typical Coin structures on disk are around 48 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
@@ -2225,7 +2290,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            if (!(fEvictCache ? pcoinsTip->Flush() : pcoinsTip->Sync())) // & 
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
@@ -2379,6 +2444,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     }
 
     chainActive.SetTip(pindexDelete->pprev);
+    SetDowsHashCacheLevel(block.GetPlainHash(), CDowsHashCache::INDEXED); // + 
 
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
@@ -2509,6 +2575,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     chainActive.SetTip(pindexNew);
+    SetDowsHashCacheLevel(blockConnecting.GetPlainHash(), CDowsHashCache::ACTIVE); // + 
     UpdateTip(pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
@@ -2963,6 +3030,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
+    SetDowsHashCacheLevel(block.GetPlainHash(), CDowsHashCache::INDEXED); // + 
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
@@ -3334,7 +3402,8 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     }
 
     // Enforce rule that the coinbase starts with serialized block height
-    if (nHeight >= consensusParams.BIP34Height)
+    // (BIP34 is active from genesis, whose coinbase is fixed and predates the rule; reindex reads it like any other block)
+    if (pindexPrev != nullptr && nHeight >= consensusParams.BIP34Height) // & 
     {
         CScript expect = CScript() << nHeight;
         if (block.vtx[0]->vin[0].scriptSig.size() < expect.size() ||
@@ -3475,6 +3544,31 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
+// { + 
+void PrecomputeBlockHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes)
+{
+    hashes.resize(headers.size());
+    std::atomic<size_t> next(0);
+    auto hash_headers = [&headers, &hashes, &next] {
+        for (size_t i = next++; i < headers.size(); i = next++) {
+            hashes[i] = headers[i].GetHash();
+        }
+    };
+
+    // The calling thread takes its share, as it does for script checks
+    size_t helpers = headers.empty() ? 0 : std::min<size_t>(std::max(nScriptCheckThreads, 0), headers.size() - 1);
+    std::vector<std::thread> threads;
+    threads.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+        threads.emplace_back(hash_headers);
+    }
+    hash_headers();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+// } + 
+
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const CDiskBlockPos* dbp) {
     unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
@@ -3604,13 +3698,6 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     if (!g_chainstate.ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed (%s)", __func__, FormatStateMessage(state));
 
-    auto gap = std::chrono::duration_cast<std::chrono::seconds>
-      (std::chrono::system_clock::now() - last_dows_cache_save_time);
-    if (gap.count () >= 86400) {
-      DumpDowsHashCache();
-      last_dows_cache_save_time = std::chrono::system_clock::now();
-    }
-
     return true;
 }
 
@@ -3928,6 +4015,28 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     if (!g_chainstate.LoadBlockIndex(chainparams.GetConsensus(), *pblocktree))
         return false;
 
+    // { + 
+    // Block index entries are loaded under the hash they were stored with.
+    // Recompute it for the entries near the best header to catch a damaged
+    // database without paying a DOWS hash for every block.
+    if (nCheckBlockIndexPow != 0 && pindexBestHeader) {
+        int64_t nStart = GetTimeMillis();
+        int nMinHeight = nCheckBlockIndexPow < 0 ? 0 : pindexBestHeader->nHeight - nCheckBlockIndexPow + 1;
+        int nChecked = 0;
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            const CBlockIndex* pindex = item.second;
+            if (pindex->nHeight < nMinHeight) {
+                continue;
+            }
+            if (pindex->GetBlockHeader().GetHash() != pindex->GetBlockHash()) {
+                return error("%s: block index entry %s does not hash to its key", __func__, pindex->ToString());
+            }
+            ++nChecked;
+        }
+        LogPrintf("%s: checked the hashes of %d block index entries in %dms\n", __func__, nChecked, GetTimeMillis() - nStart);
+    }
+    // } + 
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -4000,6 +4109,15 @@ bool LoadChainTip(const CChainParams& chainparams)
     }
     chainActive.SetTip(pindex);
 
+    // { + 
+    // Pin the active chain in the DOWS hash cache, and rank the rest of the
+    // block index above hashes of headers nobody kept
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        CBlockIndex* pindexCached = item.second;
+        SetDowsHashCacheLevel(pindexCached->GetBlockHeader().GetPlainHash(), chainActive.Contains(pindexCached) ? CDowsHashCache::ACTIVE : CDowsHashCache::INDEXED);
+    }
+    // } + 
+
     g_chainstate.PruneBlockIndexCandidates();
 
     LogPrintf("Loaded best chain: hashBestChain=%s height=%d date=%s progress=%f\n",
@@ -4057,6 +4175,12 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        // { + 
+        // ReadBlockFromDisk() only matched the header against the index, so redo its proof of work
+        uint256 hash = block.GetTestHash();
+        if (hash != pindex->GetBlockHash() || !CheckProofOfWork(hash, block.nBits, chainparams.GetConsensus()))
+            return error("VerifyDB(): *** found bad proof of work at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        // } + 
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
@@ -4339,6 +4463,7 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
+    ClearAverageDifficultyMemo(); // + 
     for (BlockMap::value_type& entry : mapBlockIndex) {
         delete entry.second;
     }
@@ -4400,6 +4525,150 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+// { + 
+namespace {
+
+/** Limits on the blocks LoadExternalBlockFile() reads ahead of the one it accepts */
+static const size_t REINDEX_BATCH_BLOCKS = 1000;
+static const size_t REINDEX_BATCH_BYTES = MAX_BLOCK_SERIALIZED_SIZE;
+
+/** A block read by LoadExternalBlockFile(), and where in the file it was found */
+struct CExternalBlock
+{
+    std::shared_ptr<CBlock> block;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Runs the context-free CheckBlock() (the DOWS hash, the merkle root and the
+ * transactions) on a batch of blocks, on up to nScriptCheckThreads threads,
+ * until it goes out of scope. AcceptBlock() then finds the blocks checked.
+ */
+class CBlockPrecheck
+{
+public:
+    CBlockPrecheck(const std::vector<CExternalBlock>& blocks, const Consensus::Params& params) : m_blocks(blocks), m_params(params)
+    {
+        size_t threads = std::min<size_t>(std::max(nScriptCheckThreads, 0), blocks.size());
+        m_threads.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~CBlockPrecheck()
+    {
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+private:
+    void Run()
+    {
+        for (size_t i = m_next++; i < m_blocks.size(); i = m_next++) {
+            CValidationState state;
+            CheckBlock(*m_blocks[i].block, state, m_params);
+        }
+    }
+
+    const std::vector<CExternalBlock>& m_blocks;
+    const Consensus::Params& m_params;
+    std::atomic<size_t> m_next{0};
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace
+
+/** Accept one block read from an external file, then the children that were waiting for it; false on a fatal error */
+static bool AcceptExternalBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const CDiskBlockPos* dbp,
+                                std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+    uint256 hash = block.GetHash();
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+          CValidationState state;
+          if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+              nLoaded++;
+          }
+          if (state.IsError()) {
+              return false;
+          }
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
+/** Accept a batch of blocks read from an external file in order; false on a fatal error */
+static bool AcceptExternalBlocks(const CChainParams& chainparams, const std::vector<CExternalBlock>& blocks, bool fHavePos,
+                                 std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    for (const CExternalBlock& external : blocks) {
+        try {
+            if (!AcceptExternalBlock(chainparams, external.block, fHavePos ? &external.pos : nullptr, mapBlocksUnknownParent, nLoaded)) {
+                return false;
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    return true;
+}
+// } + 
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4407,6 +4676,23 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
+    // { + 
+    // Blocks are read in batches. While one batch is accepted in order, the
+    // next one is checked on other threads, as DOWS hashes are slow.
+    std::vector<CExternalBlock> batch;
+    std::vector<CExternalBlock> checked;
+    size_t nBatchBytes = 0;
+    bool fFailed = false;
+    auto next_batch = [&] {
+        {
+            CBlockPrecheck precheck(batch, chainparams.GetConsensus());
+            fFailed = !AcceptExternalBlocks(chainparams, checked, dbp != nullptr, mapBlocksUnknownParent, nLoaded);
+        }
+        checked = std::move(batch);
+        batch.clear();
+        nBatchBytes = 0;
+    };
+    // } + 
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
@@ -4446,74 +4732,26 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
-
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      CValidationState state;
-                      if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
+                // { + 
+                batch.push_back({pblock, dbp ? *dbp : CDiskBlockPos()});
+                nBatchBytes += nSize;
+                if (batch.size() >= REINDEX_BATCH_BLOCKS || nBatchBytes >= REINDEX_BATCH_BYTES) {
+                    next_batch();
+                    if (fFailed)
                         break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
                 }
+                // } + 
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
+        // { + 
+        // Accept the checked batch while the last one is checked, then the last one
+        if (!fFailed)
+            next_batch();
+        if (!fFailed)
+            next_batch();
+        // } + 
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
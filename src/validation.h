@@ -161,6 +161,8 @@ extern int nScriptCheckThreads;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Recompute the block hash of block index entries this close to the best header at startup (-1 = all) */
+extern int nCheckBlockIndexPow; // + 
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -197,6 +199,8 @@ static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -checkblockindexpow */
+static const int DEFAULT_CHECKBLOCKINDEXPOW = 100; // + 
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -244,6 +248,18 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  */
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr, CBlockHeader* first_invalid = nullptr) LOCKS_EXCLUDED(cs_main);
 
+// { + 
+/**
+ * Compute the DOWS hashes of a batch of headers on up to nScriptCheckThreads
+ * extra threads. The results land in the DOWS hash cache as well, so that
+ * validating the headers afterwards under cs_main does not hash them again.
+ *
+ * @param[in]  headers The block headers
+ * @param[out] hashes  Their hashes, in the same order
+ */
+void PrecomputeBlockHashes(const std::vector<CBlockHeader>& headers, std::vector<uint256>& hashes) LOCKS_EXCLUDED(cs_main);
+// } + 
+
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0, bool blocks_dir = false);
 /** Open a block file (blk?????.dat) */